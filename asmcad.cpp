@@ -3,6 +3,14 @@
 #include <memory>
 #include <iostream>
 #include "object.h"
+#include "preview.h"
+#include "scadwriter.h"
+#include "workspace.h"
+#include "profile.h"
+#include "log.h"
+#include "render.h"
+#include "history.h"
+#include "batch.h"
 using namespace std;
 
 
@@ -15,6 +23,61 @@ void exitSDLerr(){
 
 
 int main(int argc, char* argv[]){
+    int previewWorkers = 2; // number of openscad processes rendering module images in parallel
+    string previewers = "both"; // which previewers make module images
+    string loadFile; // openscad code saved by asmcad
+    string traceFile; // timers are saved here on exit
+    bool vsync = true; // present waits for the display instead of a timer
+    bool batch = false; // export projects without a window and exit
+    string outDir = "batch"; // batch output
+    int timeout = 600; // seconds a batch openscad process may run.  0 waits forever
+    vector<string> projects; // batch input
+    bool usage = false; // unknown option
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "-j" && i+1 < argc){
+            previewWorkers = atoi(argv[++i]);
+        } else if(arg == "-p" && i+1 < argc && (argv[i+1] == string("csg") || argv[i+1] == string("openscad") || argv[i+1] == string("both"))){
+            previewers = argv[++i];
+        } else if(arg == "-v" && i+1 < argc){
+            Log::setLevel(atoi(argv[++i]));
+        } else if(arg == "--no-vsync"){
+            vsync = false;
+        } else if(arg == "--batch"){
+            batch = true;
+        } else if(arg == "-o" && i+1 < argc){
+            outDir = argv[++i];
+        } else if(arg == "--timeout" && i+1 < argc){
+            timeout = atoi(argv[++i]);
+        } else if(arg == "--split"){
+            ScadSaver::setSplit(true);
+        } else if(arg == "-m" && i+1 < argc){
+            RetainedImage::setLimit(size_t(atoi(argv[++i]))*1024*1024);
+        } else if(arg == "-t" && i+1 < argc){
+            traceFile = argv[++i];
+            Profiler::startTrace();
+        } else if(argv[i][0] != '-'){
+            if(loadFile.empty()){ loadFile = arg; }
+            projects.push_back(arg);
+        } else {
+            usage = true;
+        }
+    }
+    if(usage || (batch ? projects.empty() : projects.size() > 1)){ // the editor opens only one file
+        cout << "Usage: " << argv[0] << " [-j previewWorkers] [-p csg|openscad|both] [-v 0-3] [-m retainedMB] [-t trace.json] [--split] [--no-vsync] [file.scad|file.asmcad]" << endl;
+        cout << "       " << argv[0] << " --batch [-j openscadProcesses] [-o outDir] [--timeout seconds] [-v 0-3] [-t trace.json] file.scad|file.asmcad..." << endl;
+        return 1;
+    }
+
+    Log::start();
+    if(batch){ // no window.  See batch.h
+        int result = Batch::run(projects, outDir, previewWorkers, timeout);
+        Log::stop(); // reports below go straight to cout
+        Batch::report(cout);
+        Pool::report(cout);
+        if(!traceFile.empty()){ Profiler::saveTrace(traceFile); }
+        return result;
+    }
     if( SDL_Init( SDL_INIT_VIDEO ) < 0 ) { exitSDLerr(); } // Initialize SDL2 library
     if( !( IMG_Init( IMG_INIT_PNG ) & IMG_INIT_PNG ) ) { exitSDLerr(); } // Initialize PNG loading
 //    SDL_DisplayMode dm;
@@ -25,71 +88,212 @@ int main(int argc, char* argv[]){
     const int WINPOS = SDL_WINDOWPOS_CENTERED;
     SDL_Window* window=SDL_CreateWindow("ASM CAD", WINPOS, WINPOS, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
     if(0==window){ exitSDLerr(); }
-    SDL_Renderer * renderer = SDL_CreateRenderer(window, -1, 0);
+    SDL_Renderer * renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
     if(0==renderer){ exitSDLerr(); }
+    SDL_RendererInfo info;
+    bool paced = vsync && 0 == SDL_GetRendererInfo(renderer, &info) && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+    SDL_DisplayMode mode;
+    int refreshRate = (0 == SDL_GetWindowDisplayMode(window, &mode) && mode.refresh_rate > 0) ? mode.refresh_rate : 60;
+    const Uint32 FRAME_MS = 1000 / refreshRate; // without vsync frames are not made more often than this
+    LOG_INFO("Frames are paced by " << (paced ? "vsync" : "a timer") << " at " << refreshRate << "Hz");
     ImageLoader::setRenderer(renderer);
+    ImageLoader::preload("img");
+    PreviewQueue::start(previewWorkers);
+    ScadWriter::start("asm.scad");
+    if(previewers != "openscad"){ ScadSaver::addPreviewer( make_shared<CsgPreviewer>() ); } // fast one goes first
+    if(previewers != "csg"){ ScadSaver::addPreviewer( make_shared<OpenscadPreviewer>() ); }
+    Damage::setScreen(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    // the tree is drawn into canvas and only damaged areas are redrawn.  Dragged object is drawn on top of it
+    SDL_Texture* canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if(0==canvas){ exitSDLerr(); }
 
-    shared_ptr<Object> root = initGui(SCREEN_WIDTH, SCREEN_HEIGHT);
+    shared_ptr<Object> root = initGui(SCREEN_WIDTH, SCREEN_HEIGHT, loadFile);
+    History::setEnabled(true); // loaded design can not be undone
+    const string EXT = ".asmcad"; // Ctrl+S saves the workspace into the file it was loaded from
+    bool isWorkspace = loadFile.size() > EXT.size() && 0 == loadFile.compare(loadFile.size()-EXT.size(), EXT.size(), EXT);
+    string workspaceFile = isWorkspace ? loadFile : "asm" + EXT;
     shared_ptr<Object> draggedObject; // if not null, mouse is dragging this object
     shared_ptr<Object> inFocus; // when an object is clicked on, it becomes in focus and receives mouse wheel events
-    Point xy;
+    Point xy; // latest mouse position
+    Point pressXY; // where the button went down.  Object under it is dragged
+    SDL_GetMouseState(&xy.x, &xy.y);
     bool buttonDown = false;
+    bool moved = false; // mouse moved with the button down since the last frame.  Only the latest position is used
+    Uint32 inputTime = 0; // timestamp of the oldest input event that is not on the screen yet
+    Uint32 nextFrame = 0; // without vsync the next frame starts at this time
+    bool present = true; // screen has to be updated even if the canvas was not damaged
+    bool hud = false; // F3 shows frame statistics
     SDL_Event e;
     bool run = true;
 
+    auto inputAt = [&](Uint32 timestamp){ if(!inputTime){ inputTime = timestamp; } };
+    auto dragTo = [&](){ // takes the object and updates hover feedback once per frame
+        if(!moved){ return; }
+        PROFILE("drag");
+        moved = false;
+        if(!draggedObject){
+            Profiler::count(Profiler::HIT_TESTS);
+            History::begin();
+            draggedObject = root->takeObject(pressXY);
+            if(!draggedObject){     // if this object can not be dragged
+                History::end();
+                buttonDown = false; // end drag
+                return;
+            }
+        }
+        root->drag(xy);
+        present = true;
+    };
+
     while(run){
-        while( SDL_PollEvent( &e ) ){
-            SDL_GetMouseState(&xy.x, &xy.y);
+        bool busy = Damage::isDirty() || present;
+        if(busy && !paced){ // events that come while waiting are handled together
+            Uint32 now = SDL_GetTicks();
+            if(now < nextFrame){ SDL_Delay(nextFrame - now); }
+        }
+        // sleep until something happens if there is nothing to redraw
+        int haveEvent = busy ? SDL_PollEvent(&e) : SDL_WaitEvent(&e);
+        Profiler::frameBegin();
+        PROFILE("frame");
+        for( ; haveEvent; haveEvent = SDL_PollEvent(&e) ){
+            PROFILE("event");
             switch(e.type){
                 case SDL_QUIT:
                     run = false;
                     break;
+                case SDL_WINDOWEVENT: // window was exposed, resized etc...
+                    present = true;
+                    break;
+                case SDL_KEYDOWN:
+                    inputAt(e.key.timestamp);
+                    if(e.key.keysym.sym == SDLK_s && (e.key.keysym.mod & KMOD_CTRL)){
+                        Workspace::save(workspaceFile);
+                    } else if(e.key.keysym.sym == SDLK_z && (e.key.keysym.mod & KMOD_CTRL) && !draggedObject){
+                        if(e.key.keysym.mod & KMOD_SHIFT){ History::redo(); } else { History::undo(); }
+                    } else if(e.key.keysym.sym == SDLK_y && (e.key.keysym.mod & KMOD_CTRL) && !draggedObject){
+                        History::redo();
+                    } else if(e.key.keysym.sym == SDLK_F3){
+                        hud = !hud;
+                        present = true;
+                    }
+                    break;
                 case SDL_MOUSEBUTTONDOWN: // SDL_GetTicks() to get mouse click time
+                    inputAt(e.button.timestamp);
+                    xy = pressXY = Point(e.button.x, e.button.y);
                     buttonDown = true;
                     break;
                 case SDL_MOUSEBUTTONUP:
+                    inputAt(e.button.timestamp);
+                    dragTo(); // motion before the release
+                    xy = Point(e.button.x, e.button.y);
                     buttonDown = false;
                     if(draggedObject){
+                        draggedObject->layoutChanged(); // if it is still in the tree, put it back in its place
+                        Profiler::count(Profiler::HIT_TESTS);
                         root->dropped(xy, draggedObject);
+                        History::end(); // taking and dropping is undone in one step
                         draggedObject.reset();
+                        present = true;
                     } else if(e.button.button == SDL_BUTTON_LEFT){
+                        Profiler::count(Profiler::HIT_TESTS);
                         inFocus = root->click(xy);
                     } else if(e.button.button == SDL_BUTTON_RIGHT){
+                        Profiler::count(Profiler::HIT_TESTS);
                         inFocus = root->clickr(xy);
                     }
                     break;
-                case SDL_MOUSEMOTION:
+                case SDL_MOUSEMOTION: // handled by dragTo() after all events
+                    xy = Point(e.motion.x, e.motion.y);
                     if(!buttonDown) { break; }
-                    if(!draggedObject){
-                        draggedObject = root->takeObject(xy);
-                        if(!draggedObject){     // if this object can not be dragged
-                            buttonDown = false; // end drag
-                        }
+                    inputAt(e.motion.timestamp);
+                    moved = true;
+                    break;
+                case SDL_MOUSEWHEEL: // changes value of an Input in focus or scrolls a layout
+                    inputAt(e.wheel.timestamp);
+                    if(inFocus){
+                        inFocus->scroll(xy, e.wheel.y);
+                    } else {
+                        root->scroll(xy, e.wheel.y);
                     }
-                    root->drag(xy);
                     break;
-                case SDL_MOUSEWHEEL:
-                    if(!inFocus){ break; }
-                    inFocus->scroll(xy, e.wheel.y);
+                default:
+                    if(e.type == PreviewQueue::doneEvent){ // module images were rendered in the background
+                        PreviewQueue::poll();
+                    }
                     break;
-                default: break;
             } // switch
-        } // while
+        } // for
+        dragTo();
+
+        ScadSaver::saveView(); // keep asm.scad up to date for openscad
+        {
+            PROFILE("layout");
+            root->setLocation(Point(0,0)); // lays out only the parts that changed
+            if(draggedObject){
+                draggedObject->setLocation(xy);
+            }
+        }
+        if(!Damage::isDirty() && !present){
+            Damage::frameSkipped();
+            inputTime = 0; // input did not change anything on the screen
+            continue;
+        }
 
-        SDL_SetRenderDrawBlendMode(renderer,SDL_BLENDMODE_NONE);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-        SDL_RenderClear(renderer);
+        if(Damage::isDirty()){ // redraw damaged area of the canvas
+            PROFILE("draw");
+            SDL_Rect area = Damage::take();
+            SDL_SetRenderTarget(renderer, canvas);
+            SDL_RenderSetClipRect(renderer, &area);
+            SDL_SetRenderDrawBlendMode(renderer,SDL_BLENDMODE_NONE);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+            SDL_RenderFillRect(renderer, &area); // SDL_RenderClear() ignores the clip rectangle
+            Profiler::count(Profiler::DRAW_CALLS);
+            Profiler::count(Profiler::DRAW_COMMANDS);
+            root->draw(renderer);
+            RenderBatch::flush(renderer);
+            SDL_RenderSetClipRect(renderer, NULL);
+            SDL_SetRenderTarget(renderer, NULL);
+        }
 
-        root->draw(renderer);
+        SDL_RenderCopy(renderer, canvas, NULL, NULL);
+        Profiler::count(Profiler::DRAW_CALLS);
+        Profiler::count(Profiler::DRAW_COMMANDS);
         if(draggedObject){
-            draggedObject->setLocation(xy);
             draggedObject->draw(renderer);
+            RenderBatch::flush(renderer);
+        }
+        if(hud){
+            Profiler::drawHud(renderer);
         }
 
-        SDL_RenderPresent(renderer);
-        SDL_Delay( 16 ); // less than 60fps
+        {
+            PROFILE("present");
+            SDL_RenderPresent(renderer); // waits for vsync if paced
+        }
+        Uint32 presented = SDL_GetTicks();
+        nextFrame = presented + FRAME_MS;
+        if(inputTime){
+            Profiler::inputPresented(presented - inputTime);
+            inputTime = 0;
+        }
+        Damage::frameRendered();
+        Profiler::frameEnd();
+        present = false;
     }
+    Log::stop(); // reports below go straight to cout
+    cout << "Frames rendered: " << Damage::framesRendered() << " skipped: " << Damage::framesSkipped() << endl;
+    Profiler::report(cout);
+    ThumbnailCache::report(cout);
+    ImageLoader::report(cout);
+    RenderBatch::report(cout);
+    Pool::report(cout);
+    ScadWriter::stop();
+    ScadWriter::report(cout);
+    if(!traceFile.empty()){ Profiler::saveTrace(traceFile); }
 
+    PreviewQueue::stop();
+    SDL_DestroyTexture(canvas);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "batch.h"
+#include "object.h"
+#include "preview.h"
+#include "loader.h"
+#include "workspace.h"
+#include "modgraph.h"
+#include "log.h"
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+struct BatchJob {
+    enum State {READY, RUNNING, OK, FAILED, TIMEOUT, SKIPPED} state = READY;
+    string name;    // project/modN.png in the report
+    string scadFile;
+    string outFile;
+    double seconds = 0; // openscad run time
+};
+
+static mutex mtx; // protects everything below
+static condition_variable cv;
+static deque<shared_ptr<BatchJob>> ready;
+static vector<shared_ptr<BatchJob>> jobs; // all jobs in the order they were added
+static size_t finished = 0;
+static bool stopping = false;
+static unsigned long projectsLoaded = 0, projectsFailed = 0;
+static double loadSeconds = 0, totalSeconds = 0;
+static int processCount = 0;
+static int timeout = 0; // seconds openscad may run
+
+static const char* stateText(BatchJob::State state){
+    switch(state){
+        case BatchJob::OK:      return "ok";
+        case BatchJob::FAILED:  return "FAILED";
+        case BatchJob::TIMEOUT: return "TIMEOUT";
+        case BatchJob::SKIPPED: return "skipped";
+        default:                return "not run";
+    }
+}
+
+// skipped jobs are done when added.  Jobs do not wait for each other: modN.scad has all code it needs
+static void addJob(shared_ptr<BatchJob> const & job){
+    lock_guard<mutex> lock(mtx);
+    jobs.push_back(job);
+    if(BatchJob::SKIPPED == job->state){
+        ++finished;
+        return;
+    }
+    ready.push_back(job);
+    cv.notify_all();
+}
+
+static void worker(){
+    unique_lock<mutex> lock(mtx);
+    while(true){
+        cv.wait(lock, []{ return stopping || !ready.empty(); });
+        if(ready.empty()){ return; } // stopping
+        auto job = ready.front();
+        ready.pop_front();
+        job->state = BatchJob::RUNNING;
+        lock.unlock();
+
+        auto start = Clock::now();
+        bool ok = Openscad::run(job->scadFile, job->outFile, nullptr, timeout);
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+        if(!ok){ remove(job->outFile.c_str()); } // it could be half written
+        LOG_DEBUG(job->name << " " << (ok ? "rendered" : "failed") << " in " << int(1000*seconds) << "ms");
+
+        lock.lock();
+        job->seconds = seconds;
+        job->state = ok ? BatchJob::OK : timeout > 0 && seconds >= timeout ? BatchJob::TIMEOUT : BatchJob::FAILED;
+        ++finished;
+        cv.notify_all(); // run() waits for the last job
+    }
+}
+
+static void makeDir(const string& dir){ // it may exist already
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+static bool endsWith(const string& s, const string& end){
+    return s.size() > end.size() && 0 == s.compare(s.size()-end.size(), end.size(), end);
+}
+
+static string baseName(const string& file){ // dir/name.asmcad -> name
+    string name = file.substr(file.find_last_of("/\\") + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == string::npos || 0 == dot ? name : name.substr(0, dot);
+}
+
+static bool writeFile(const string& fileName, const string& code){
+    ofstream file(fileName, ios_base::out | ios::trunc);
+    file << code;
+    file.close();
+    if(!file.good()){ LOG_ERROR("can not write " << fileName); }
+    return file.good();
+}
+
+// load a project, save its code into dir and add openscad jobs for all of its modules.  Returns false on error
+static bool exportProject(const string& project, const string& dir){
+    auto start = Clock::now();
+    auto main = makeObject<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto labels = makeObject<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    bool ok;
+    if(endsWith(project, ".asmcad")){
+        Workspace::setLayouts(main, labels);
+        ok = Workspace::load(project);
+    } else {
+        ok = ScadLoader::load(project, main, labels);
+    }
+    if(!ok){ return false; } // loaders report errors
+
+    string name = dir.substr(dir.find_last_of('/') + 1);
+    makeDir(dir);
+    stringstream all;
+    ok = main->writeScad(all) && writeFile(dir + "/asm.scad", all.str());
+
+    ModuleGraph graph; // callees are sorted before modules calling them
+    unordered_map<int, bool> exported; // by module id: modN.scad of it and of all modules it calls were saved
+    for(auto& label: labels->getChildren()){
+        auto mod = dynamic_pointer_cast<Module>(label);
+        vector<shared_ptr<Operator>> order;
+        if(!mod || !graph.sort(mod->getOperator(), order)){
+            ok = false;
+            continue;
+        }
+        for(auto& op: order){
+            int id = op->getModuleId();
+            if(exported.count(id)){ continue; }
+            bool calleesOk = true; // otherwise a broken module is reported by every module calling it
+            for(int callee: graph.calls(id)){
+                calleesOk = calleesOk && exported[callee];
+            }
+            string code, file = dir + "/" + op->getModuleName();
+            bool saved = calleesOk && ScadSaver::moduleCode(op, code) && writeFile(file + ".scad", code + "\n" + op->getModuleName() + "();\n");
+            exported[id] = saved;
+            ok = saved && ok;
+            if(!saved && calleesOk){ continue; } // its own code failed and was logged
+            const char* formats[] = {".png", ".stl"};
+            for(size_t f = 0; f < 2; ++f){
+                auto job = make_shared<BatchJob>();
+                job->name = name + "/" + op->getModuleName() + formats[f];
+                job->scadFile = file + ".scad";
+                job->outFile = file + formats[f];
+                if(!saved){ job->state = BatchJob::SKIPPED; }
+                addJob(job);
+            }
+        }
+    }
+    lock_guard<mutex> lock(mtx);
+    loadSeconds += chrono::duration<double>(Clock::now() - start).count();
+    LOG_INFO("Exported " << project << " into " << dir << " with " << exported.size() << " modules");
+    return ok;
+}
+
+int Batch::run(const vector<string>& projects, const string& outDir, int processes, int timeoutSeconds){
+    auto start = Clock::now();
+    ImageLoader::setHeadless(); // objects load no images and modules get none from previewers
+    makeDir(outDir);
+    stopping = false;
+    processCount = max(1, processes);
+    timeout = timeoutSeconds;
+    vector<thread> workers;
+    for(int i = 0; i < processCount; ++i){
+        workers.push_back( thread(worker) );
+    }
+    bool ok = true;
+    unordered_set<string> dirs; // projects with the same name go into name_2, name_3...
+    for(auto& p: projects){
+        string name = baseName(p), dir = outDir + "/" + name;
+        for(int n = 2; !dirs.insert(dir).second; ++n){
+            dir = outDir + "/" + name + "_" + to_string(n);
+        }
+        bool loaded = exportProject(p, dir);
+        if(!loaded){ LOG_ERROR("can not export " << p); }
+        lock_guard<mutex> lock(mtx);
+        if(loaded){ ++projectsLoaded; } else { ++projectsFailed; }
+        ok = loaded && ok;
+    }
+    {
+        unique_lock<mutex> lock(mtx);
+        cv.wait(lock, []{ return finished == jobs.size(); });
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto& t: workers){ t.join(); }
+    totalSeconds = chrono::duration<double>(Clock::now() - start).count();
+    for(auto& j: jobs){ ok = BatchJob::OK == j->state && ok; }
+    return ok ? 0 : 1;
+}
+
+void Batch::report(ostream& out){
+    lock_guard<mutex> lock(mtx);
+    unsigned long count[BatchJob::SKIPPED+1] = {0};
+    double busy = 0, slowest = 0;
+    for(auto& j: jobs){
+        out << "  " << left << setw(32) << j->name << right << setw(8) << stateText(j->state);
+        if(BatchJob::OK == j->state || BatchJob::FAILED == j->state || BatchJob::TIMEOUT == j->state){ out << setw(8) << int(1000*j->seconds) << " ms"; }
+        out << endl;
+        ++count[j->state];
+        busy += j->seconds;
+        slowest = max(slowest, j->seconds);
+    }
+    out << "Batch: " << projectsLoaded << " projects exported, " << projectsFailed << " failed.  " << jobs.size() << " openscad jobs: "
+        << count[BatchJob::OK] << " ok, " << count[BatchJob::FAILED] << " failed, " << count[BatchJob::TIMEOUT] << " timed out, "
+        << count[BatchJob::SKIPPED] << " skipped" << endl;
+    out << fixed << setprecision(2) << "Batch: " << totalSeconds << " s total, " << loadSeconds << " s loading and saving code";
+    if(totalSeconds > 0){
+        out << ", " << jobs.size()/totalSeconds << " jobs/s, " << (projectsLoaded+projectsFailed)/totalSeconds << " projects/s, "
+            << processCount << " openscad processes busy " << int(100*busy/(processCount*totalSeconds)) << "% of the time";
+    }
+    unsigned long ran = count[BatchJob::OK] + count[BatchJob::FAILED] + count[BatchJob::TIMEOUT];
+    if(ran){ out << ", job avg " << busy/ran << " s max " << slowest << " s"; }
+    out << defaultfloat << endl;
+}
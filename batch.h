@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Exports projects without a window or renderer (asmcad --batch) for scripts such as nightly builds.
+// Each project (.scad or .asmcad) is loaded, its code is saved and openscad renders every module.
+// Files of project dir/name.asmcad are saved into outDir/name/ (outDir/name_2/... if another project has the same name):
+//     asm.scad           all code of the project.  It can be loaded into the editor again
+//     modN.scad          module N and the modules it calls followed by a call of N.  Same code as its image in the editor
+//     modN.png modN.stl  rendered by openscad from modN.scad
+// At most `processes` openscad processes run at the same time, in any order since modN.scad needs no other file.  Modules
+// calling a module whose code could not be saved are skipped so that a broken module is reported only once.
+// openscad is killed after timeoutSeconds (0 waits forever).
+// Projects are loaded and saved while openscad renders the ones before them.
+class Batch {
+public:
+    // returns 0 if every project was loaded and every module rendered, 1 otherwise.  Logging has to be started
+    static int run(const std::vector<std::string>& projects, const std::string& outDir, int processes, int timeoutSeconds);
+    static void report(std::ostream& out); // time of every job and throughput
+};
@@ -0,0 +1,596 @@
+// Benchmarks for asmcad.  Run "make bench" or ./asmcad-bench [-n operators] [-d depth] [-f fanout]
+// Runs without a display using SDL's dummy video driver and a software renderer.
+// Every result is printed as one line of JSON so that results of different versions can be compared by scripts.
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <SDL2/SDL_image.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "object.h"
+#include "spatial.h"
+#include "csg.h"
+#include "loader.h"
+#include "workspace.h"
+#include "profile.h"
+#include "log.h"
+#include "render.h"
+#include "modgraph.h"
+#include "history.h"
+using namespace std;
+
+static ostream out(cout.rdbuf()); // results.  cout is silenced since the editor logs to it
+static int N = 100, D = 2, F = 4; // design size: N operators in Main, each D levels deep with F shapes/modifiers per level
+
+
+// every heap allocation is counted
+static unsigned long long allocations = 0, allocatedBytes = 0, freedBytes = 0;
+
+void* operator new(size_t size){
+    ++allocations;
+    allocatedBytes += size;
+    size_t* p = (size_t*)malloc(size + sizeof(max_align_t)); // size is remembered in front of the block
+    if(!p){ throw bad_alloc(); }
+    *p = size;
+    return (char*)p + sizeof(max_align_t);
+}
+void operator delete(void* ptr) noexcept {
+    if(!ptr){ return; }
+    size_t* p = (size_t*)((char*)ptr - sizeof(max_align_t));
+    freedBytes += *p;
+    free(p);
+}
+void* operator new[](size_t size){ return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+static double now(){ // seconds
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const string& name, int n, double seconds, int ops){
+    out << "{\"bench\":\"" << name << "\",\"n\":" << n << ",\"depth\":" << D << ",\"fanout\":" << F << ",\"ops\":" << ops
+        << ",\"seconds\":" << seconds << ",\"ns_per_op\":" << 1e9*seconds/max(1,ops) << "}" << endl;
+}
+
+// rectangles placed the same way FlowLayout places its children
+static vector<SDL_Rect> flowRects(int n, int width){
+    vector<SDL_Rect> rects;
+    int x = 0, y = 0;
+    for(int i = 0; i < n; ++i){
+        if(x+100 > width){
+            x = 0;
+            y += 150;
+        }
+        rects.push_back({x, y, 100, 150});
+        x += 100;
+    }
+    return rects;
+}
+
+// SpatialGrid and RectArray vs. the linear scan FlowLayout used before
+static bool benchHitTest(int n){
+    const int QUERIES = 200000;
+    auto rects = flowRects(n, 1100);
+    vector<Point> points;
+    int height = rects.back().y + 150;
+    for(int i = 0; i < QUERIES; ++i){
+        points.push_back( Point(rand()%1100, rand()%height) );
+    }
+
+    vector<int> linear(QUERIES);
+    double t = now();
+    for(int q = 0; q < QUERIES; ++q){
+        linear[q] = -1;
+        for(int i = 0; i < n; ++i){
+            if(points[q].inRectangle(rects[i])){
+                linear[q] = i;
+                break;
+            }
+        }
+    }
+    report("hittest_linear", n, now()-t, QUERIES);
+
+    SpatialGrid grid;
+    t = now();
+    grid.build(rects);
+    report("hittest_grid_build", n, now()-t, 1);
+
+    bool same = true;
+    t = now();
+    for(int q = 0; q < QUERIES; ++q){
+        same = (grid.find(points[q]) == linear[q]) && same;
+    }
+    report("hittest_grid", n, now()-t, QUERIES);
+    if(!same){ cerr << "ERROR: SpatialGrid and linear scan found different objects" << endl; }
+
+    // the same scan over RectArray with each kernel the CPU supports.  Also culling against random clip rectangles
+    RectArray array;
+    array.resize(n);
+    for(int i = 0; i < n; ++i){ array.set(i, rects[i]); }
+    vector<SDL_Rect> clips;
+    for(int q = 0; q < QUERIES/100; ++q){
+        clips.push_back({rand()%1100 - 100, rand()%height - 100, 1 + rand()%400, 1 + rand()%400});
+    }
+    vector<int> culled;
+    for(auto& c: clips){
+        for(int i = 0; i < n; ++i){ culled.push_back( SDL_HasIntersection(&c, &rects[i]) ? i : -1 ); }
+    }
+    string best = RectArray::kernel();
+    vector<int> hits;
+    for(string kernel: {"scalar", "sse2", "avx2"}){
+        if(!RectArray::useKernel(kernel)){ continue; }
+        bool sameHits = true, sameCulled = true;
+        t = now();
+        for(int q = 0; q < QUERIES; ++q){
+            array.query(points[q], 0, n, hits);
+            sameHits = (hits.empty() ? -1 : hits.front()) == linear[q] && sameHits;
+        }
+        report("hittest_" + kernel, n, now()-t, QUERIES);
+        size_t k = 0;
+        t = now();
+        for(auto& c: clips){
+            array.overlapping(c, 0, n, hits);
+            size_t h = 0;
+            for(int i = 0; i < n; ++i, ++k){ // every rectangle the SDL test finds and nothing else
+                bool found = h < hits.size() && hits[h] == i;
+                h += found;
+                sameCulled = found == (culled[k] >= 0) && sameCulled;
+            }
+        }
+        report("cull_" + kernel, n, now()-t, clips.size());
+        if(!sameHits || !sameCulled){ cerr << "ERROR: " << kernel << " RectArray kernel and linear scan found different objects" << endl; }
+        same = sameHits && sameCulled && same;
+    }
+    RectArray::useKernel(best);
+    return same;
+}
+
+
+// remembers the size of the block std::allocate_shared() asks for: the object and its reference counts
+static size_t sharedBlock = 0;
+template<class T> struct SizeAllocator {
+    typedef T value_type;
+    SizeAllocator(){}
+    template<class U> SizeAllocator(const SizeAllocator<U>&){}
+    T* allocate(size_t n){
+        sharedBlock = n*sizeof(T);
+        return static_cast<T*>( ::operator new(sharedBlock) );
+    }
+    void deallocate(T* p, size_t){ ::operator delete(p); }
+};
+template<class T, class U> bool operator==(const SizeAllocator<T>&, const SizeAllocator<U>&){ return true; }
+template<class T, class U> bool operator!=(const SizeAllocator<T>&, const SizeAllocator<U>&){ return false; }
+
+// bytes each node pays for shared ownership: the control block, the weak_ptr in enable_shared_from_this
+// and the count pointer of the shared_ptr its container holds
+template<class T, class Arg> static void reportNodeSize(const string& type, Arg arg){
+    allocate_shared<T>(SizeAllocator<T>(), arg);
+    size_t ownership = sharedBlock - sizeof(T) + sizeof(enable_shared_from_this<Object>) + sizeof(shared_ptr<Object>) - sizeof(Object*);
+    out << "{\"bench\":\"node_size\",\"type\":\"" << type << "\",\"object_bytes\":" << sizeof(T)
+        << ",\"block_bytes\":" << sharedBlock << ",\"ownership_bytes\":" << ownership << "}" << endl;
+}
+
+static shared_ptr<Object> leaf(int i){ // alternate between shapes and modifiers
+    switch(i%4){
+        case 0:  return make_shared<Shape>(Shape::CUBE)->clone();
+        case 1:  return make_shared<Modifier>(Modifier::TRANSLATE)->clone();
+        case 2:  return make_shared<Shape>(Shape::SPHERE)->clone();
+        default: return make_shared<Modifier>(Modifier::ROTATE)->clone();
+    }
+}
+
+// an operator with F shapes/modifiers and one nested operator if depth > 1
+static shared_ptr<Object> makeOperator(int depth){
+    auto op = make_shared<Operator>( Operator::OperatorType(depth%3) )->clone();
+    for(int i = 0; i < F; ++i){
+        op->dropped(Point(), leaf(i));
+    }
+    if(depth > 1){ op->dropped(Point(), makeOperator(depth-1)); }
+    return op;
+}
+
+static bool benchDesign(SDL_Renderer* renderer){
+    const int QUERIES = 1000;
+    auto main = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    const Point origin(ITEM_WIDTH, ITEM_HEIGHT);
+
+    unsigned long long allocs = allocations, live = allocatedBytes - freedBytes;
+    double t = now();
+    for(int i = 0; i < N; ++i){
+        main->addObject( makeOperator(D) );
+    }
+    report("build", N, now()-t, N);
+    int nodes = 0; // operators, shapes and modifiers
+    for(int d = 1; d <= D; ++d){ nodes = 1 + F + nodes; }
+    nodes *= N;
+    out << "{\"bench\":\"memory\",\"n\":" << N << ",\"depth\":" << D << ",\"fanout\":" << F << ",\"nodes\":" << nodes
+        << ",\"allocations_per_node\":" << double(allocations - allocs)/nodes
+        << ",\"bytes_per_node\":" << double(allocatedBytes - freedBytes - live)/nodes << "}" << endl;
+
+    t = now();
+    main->setLocation(origin);
+    report("layout_full", N, now()-t, 1);
+
+    t = now();
+    main->setLocation(origin); // nothing changed
+    report("layout_clean", N, now()-t, 1);
+
+    vector<Point> points;
+    for(int i = 0; i < QUERIES; ++i){
+        points.push_back( Point(origin.x + rand()%main->loc.w, origin.y + rand()%main->loc.h) );
+    }
+
+    int found = 0;
+    t = now();
+    for(auto& p: points){ found += main->click(p) ? 1 : 0; }
+    report("click", N, now()-t, QUERIES);
+
+    allocs = allocations;
+    t = now();
+    for(auto& p: points){ main->takeObject(p); } // rows are clones and are not removed from Main
+    report("takeObject", N, now()-t, QUERIES);
+    out << "{\"bench\":\"takeObject_allocations\",\"n\":" << N << ",\"allocations_per_op\":" << double(allocations - allocs)/QUERIES << "}" << endl;
+
+    auto shape = leaf(0);
+    t = now();
+    for(auto& p: points){ main->dropped(p, shape); } // only the first drop adds it
+    report("dropped", N, now()-t, QUERIES);
+
+    auto row = main->takeObject( Point(origin.x+1, origin.y+1) ); // first visible row
+    if(row){
+        t = now();
+        row->dropped(Point(), leaf(1)); // one row changed
+        main->setLocation(origin);
+        report("layout_incremental", N, now()-t, 1);
+    }
+
+    const int FRAMES = 20;
+    unsigned long commands = RenderBatch::commands(), calls = RenderBatch::calls();
+    t = now();
+    for(int i = 0; i < FRAMES; ++i){
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+        SDL_RenderClear(renderer);
+        main->draw(renderer);
+        RenderBatch::flush(renderer);
+    }
+    report("draw", N, now()-t, FRAMES);
+    out << "{\"bench\":\"draw_calls\",\"n\":" << N << ",\"commands_per_frame\":" << (RenderBatch::commands() - commands)/FRAMES
+        << ",\"calls_per_frame\":" << (RenderBatch::calls() - calls)/FRAMES << "}" << endl; // unbatched: one call per command
+
+    for(auto& row: main->getChildren()){ row->setRetained(true); } // rows are drawn once, then copied
+    calls = RenderBatch::calls();
+    t = now();
+    for(int i = 0; i < FRAMES; ++i){
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+        SDL_RenderClear(renderer);
+        main->draw(renderer);
+        RenderBatch::flush(renderer);
+    }
+    report("draw_retained", N, now()-t, FRAMES);
+    out << "{\"bench\":\"retained_images\",\"n\":" << N << ",\"calls_per_frame\":" << (RenderBatch::calls() - calls)/FRAMES
+        << ",\"kbytes\":" << RetainedImage::memory()/1024 << "}" << endl;
+    for(auto& row: main->getChildren()){ row->setRetained(false); }
+
+    stringstream code;
+    t = now();
+    main->writeScad(code);
+    report("saveScad_full", N, now()-t, 1);
+    size_t bytes = code.str().size();
+
+    t = now();
+    code.str("");
+    main->writeScad(code);
+    report("saveScad_clean", N, now()-t, 1);
+    string clean = code.str();
+
+    bool valueSaved = false; // the edited value is in the new code
+    for(auto& p: points){ // change a value in one of the inputs
+        auto input = dynamic_pointer_cast<Input>( main->click(p) );
+        if(!input){ continue; }
+        input->scroll(p, 1);
+        t = now();
+        code.str("");
+        main->writeScad(code);
+        report("saveScad_incremental", N, now()-t, 1);
+        stringstream full; // same code generated without the cache
+        main->saveScad(full);
+        valueSaved = code.str() != clean && code.str() == full.str();
+        break;
+    }
+    out << "{\"bench\":\"value_edit\",\"n\":" << N << ",\"saved\":" << (valueSaved ? "true" : "false") << "}" << endl;
+    if(!valueSaved){ cerr << "ERROR: changed value is not in the saved code" << endl; }
+    row = main->takeObject( Point(origin.x+1, origin.y+1) );
+    auto op = dynamic_pointer_cast<Operator>(row);
+    if(op){ // in-process module image
+        const int IMAGES = 10;
+        t = now();
+        for(int i = 0; i < IMAGES; ++i){
+            CsgBuilder csg;
+            op->saveModuleCsg(csg);
+            SDL_FreeSurface( renderCsg(csg.nodes, ITEM_WIDTH, ITEM_HEIGHT) );
+        }
+        report("preview_csg", N, now()-t, IMAGES);
+    }
+
+    out << "{\"bench\":\"design\",\"n\":" << N << ",\"depth\":" << D << ",\"fanout\":" << F
+        << ",\"scad_bytes\":" << bytes << ",\"clicked_inputs\":" << found << "}" << endl;
+    return valueSaved;
+}
+
+// moves rows into other rows, changes values and turns rows into modules by dropping them on Labels and on the view.
+// Undoes all of it and checks that the code is the same as before
+static bool benchHistory(){
+    auto main = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto labels = make_shared<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto view = make_shared<DropZone>(DropZone::VIEW, main);
+    for(int i = 0; i < N; ++i){
+        main->addObject( makeOperator(D) );
+    }
+    stringstream before;
+    main->writeScad(before);
+
+    History::setEnabled(true);
+    const int EDITS = min(100, N/2);
+    unsigned long long live = allocatedBytes - freedBytes;
+    double t = now();
+    for(int i = 0; i < EDITS; ++i){ // like dragging a row into the next one and scrolling one of its inputs
+        auto row = main->getChildren()[i];
+        auto next = static_pointer_cast<Operator>(main->getChildren()[i+1]);
+        History::begin();
+        main->removeChild(row);
+        next->addObject(row);
+        History::end();
+        auto xyz = static_pointer_cast<XYZ>(next->getChildren().front());
+        xyz->getInput(0).setValue(i);
+        xyz->getInput(0).setValue(i+0.5); // same step
+    }
+    auto last = main->getChildren().back(); // dragged from Main onto Labels.  Becomes a module
+    History::begin();
+    main->removeChild(last);
+    labels->dropped(Point(), last);
+    History::end();
+    History::begin(); // dropped on the view.  Stays in Main as a module
+    view->dropped(Point(), main->getChildren().back());
+    History::end();
+    bool modulesMade = 1 == labels->getChildren().size() && static_pointer_cast<Operator>(main->getChildren().back())->getModuleId();
+    report("history_edit", N, now()-t, EDITS+2);
+    size_t steps = History::undoSteps();
+    double bytesPerStep = double(allocatedBytes - freedBytes - live)/steps;
+    stringstream after;
+    main->writeScad(after);
+
+    t = now();
+    while(History::undo()){}
+    report("history_undo", N, now()-t, steps);
+    stringstream undone;
+    main->writeScad(undone);
+    bool modulesUndone = labels->getChildren().empty() && !static_pointer_cast<Operator>(main->getChildren().back())->getModuleId()
+                         && !static_pointer_cast<Operator>(last)->getModuleId();
+    t = now();
+    while(History::redo()){}
+    report("history_redo", N, now()-t, steps);
+    stringstream redone;
+    main->writeScad(redone);
+    History::clear();
+    History::setEnabled(false);
+
+    bool same = undone.str() == before.str() && redone.str() == after.str() && after.str() != before.str()
+                && modulesMade && modulesUndone && 1 == labels->getChildren().size();
+    out << "{\"bench\":\"history\",\"n\":" << N << ",\"steps\":" << steps << ",\"bytes_per_step\":" << bytesPerStep
+        << ",\"same\":" << (same ? "true" : "false") << "}" << endl;
+    if(!same){ cerr << "ERROR: undo or redo did not restore the code" << endl; }
+    return same;
+}
+
+// copies of a module made while its image is still rendering get the image when PreviewQueue::poll() sets it
+static bool benchModuleImages(){
+    auto main = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto labels = make_shared<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto view = make_shared<DropZone>(DropZone::VIEW, main);
+    auto op = static_pointer_cast<Operator>( makeOperator(D) );
+    auto other = static_pointer_cast<Operator>( makeOperator(D) );
+    main->addObject(op);
+    main->addObject(other);
+    auto label = op->getModule();
+    labels->addObject(label);
+    auto call = label->clone(); // placed into a row of Main
+    other->dropped(Point(), call);
+    view->dropped(Point(), label);
+
+    SDL_Surface* s = SDL_CreateRGBSurfaceWithFormat(0, ITEM_WIDTH, ITEM_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    auto texture = ImageLoader::getImage(s);
+    SDL_FreeSurface(s);
+    op->setModuleImage(texture); // what poll() does when openscad is done
+    bool shown = texture && label->img == texture && call->img == texture && view->img == texture;
+
+    view->dropped(Point(), other); // views another module now
+    s = SDL_CreateRGBSurfaceWithFormat(0, ITEM_WIDTH, ITEM_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    auto later = ImageLoader::getImage(s);
+    SDL_FreeSurface(s);
+    op->setModuleImage(later);
+    shown = shown && label->img == later && call->img == later && view->img != later;
+    out << "{\"bench\":\"module_images\",\"shown\":" << (shown ? "true" : "false") << "}" << endl;
+    if(!shown){ cerr << "ERROR: copies of a module do not show its rendered image" << endl; }
+    return shown;
+}
+
+// saves a design with modules into a file, loads it back and checks that it generates the same code
+static bool benchLoad(){
+    const string FILE_NAME = "bench.scad";
+    auto main = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto labels = make_shared<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    vector<shared_ptr<Operator>> modules;
+    for(int i = 0; i < N; ++i){
+        auto op = static_pointer_cast<Operator>( makeOperator(D) );
+        main->addObject(op);
+        if(!modules.empty()){ op->dropped(Point(), modules[rand()%modules.size()]->getModuleCall()); }
+        if(0 == i%10){ // every 10th operator becomes a module
+            labels->addObject( op->getModule() );
+            modules.push_back(op);
+        }
+    }
+    stringstream code;
+    main->writeScad(code);
+    code << endl << modules[0]->getModuleName() << "();" << endl;
+    ofstream(FILE_NAME) << code.str();
+
+    auto loadedMain = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    auto loadedLabels = make_shared<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    double t = now();
+    bool ok = ScadLoader::load(FILE_NAME, loadedMain, loadedLabels);
+    report("load", N, now()-t, 1);
+    remove(FILE_NAME.c_str());
+
+    stringstream loaded;
+    loadedMain->writeScad(loaded);
+    loaded << endl << modules[0]->getModuleName() << "();" << endl;
+    bool same = ok && loaded.str() == code.str();
+    out << "{\"bench\":\"load_roundtrip\",\"n\":" << N << ",\"scad_bytes\":" << code.str().size()
+        << ",\"modules\":" << modules.size() << ",\"same\":" << (same ? "true" : "false") << "}" << endl;
+    if(!same){ cerr << "ERROR: loaded code is different from saved code" << endl; }
+
+    const int EXPORTS = 100; // code of the last module for its image instead of all of Main
+    ModuleGraph graph;
+    string pruned;
+    bool exported = true;
+    t = now();
+    for(int i = 0; i < EXPORTS; ++i){
+        graph.clear();
+        stringstream s;
+        exported = graph.saveScad(modules.back(), s) && exported;
+        pruned = s.str();
+    }
+    report("export_pruned", N, now()-t, EXPORTS);
+    if(!exported){ cerr << "ERROR: code of a module could not be exported" << endl; }
+    out << "{\"bench\":\"export_size\",\"n\":" << N << ",\"full_bytes\":" << code.str().size() << ",\"pruned_bytes\":" << pruned.size()
+        << ",\"modules\":" << modules.size() << ",\"needed_modules\":" << graph.size() << "}" << endl;
+
+    auto a = static_pointer_cast<Operator>( makeOperator(1) ); // modules calling each other
+    auto b = static_pointer_cast<Operator>( makeOperator(1) );
+    a->getModule();
+    b->getModule();
+    a->dropped(Point(), b->getModuleCall());
+    b->dropped(Point(), a->getModuleCall());
+    graph.clear();
+    vector<shared_ptr<Operator>> order;
+    bool cycleFound = !graph.sort(a, order) && 3 == graph.cycle.size();
+    out << "{\"bench\":\"module_cycle\",\"found\":" << (cycleFound ? "true" : "false") << "}" << endl;
+    if(!cycleFound){ cerr << "ERROR: modules calling each other were not found" << endl; }
+
+    const string WORKSPACE_FILE = "bench.asmcad"; // same design as a binary workspace
+    Workspace::setLayouts(main, labels);
+    t = now();
+    ok = Workspace::save(WORKSPACE_FILE) && ok;
+    report("workspace_save", N, now()-t, 1);
+    loadedMain = make_shared<Main>(1200-ITEM_WIDTH, 900-ITEM_HEIGHT);
+    loadedLabels = make_shared<Labels>(ITEM_WIDTH, 900-ITEM_HEIGHT);
+    Workspace::setLayouts(loadedMain, loadedLabels);
+    t = now();
+    ok = Workspace::load(WORKSPACE_FILE) && ok;
+    report("workspace_load", N, now()-t, 1);
+    remove(WORKSPACE_FILE.c_str());
+
+    loaded.str("");
+    loadedMain->writeScad(loaded);
+    loaded << endl << modules[0]->getModuleName() << "();" << endl;
+    bool sameWorkspace = ok && loaded.str() == code.str();
+    out << "{\"bench\":\"workspace_roundtrip\",\"n\":" << N << ",\"same\":" << (sameWorkspace ? "true" : "false") << "}" << endl;
+    if(!sameWorkspace){ cerr << "ERROR: loaded workspace is different from saved one" << endl; }
+    return same && exported && cycleFound && sameWorkspace;
+}
+
+
+// cost of a debug message written into the log's buffer.  Messages that do not fit are dropped
+static void benchLog(){
+    const int MESSAGES = 100000;
+    Log::setLevel(Log::DBG);
+    Log::start();
+    double t = now();
+    for(int i = 0; i < MESSAGES; ++i){
+        LOG(Log::DBG, "HLayout setting location at (" << i << "," << i << ") size (100,150)");
+    }
+    report("log", N, now()-t, MESSAGES);
+    Log::stop();
+    out << "{\"bench\":\"log_dropped\",\"n\":" << N << ",\"messages\":" << MESSAGES << ",\"dropped\":" << Log::dropped() << "}" << endl;
+    Log::setLevel(Log::ERR);
+}
+
+// cost of a PROFILE() scope when not tracing and when tracing.  Tracing can not be turned off so this runs last
+static bool benchProfiler(){
+    const int SCOPES = 1000000;
+    volatile int sink = 0;
+    double t = now();
+    for(int i = 0; i < SCOPES; ++i){
+        PROFILE("bench");
+        sink = sink + 1;
+    }
+    report("profile_off", N, now()-t, SCOPES);
+
+    Profiler::startTrace();
+    t = now();
+    for(int i = 0; i < SCOPES/10; ++i){
+        PROFILE("bench");
+        sink = sink + 1;
+    }
+    report("profile_on", N, now()-t, SCOPES/10);
+    const string TRACE_FILE = "bench_trace.json";
+    bool ok = Profiler::saveTrace(TRACE_FILE);
+    remove(TRACE_FILE.c_str());
+    if(!ok){ cerr << "ERROR: could not save the trace" << endl; }
+    return ok;
+}
+
+
+int main(int argc, char* argv[]){
+    for(int i = 1; i+1 < argc; i += 2){
+        string arg = argv[i];
+        int val = atoi(argv[i+1]);
+        if(arg == "-n"){ N = val; }
+        else if(arg == "-d"){ D = val; }
+        else if(arg == "-f"){ F = val; }
+    }
+    srand(1); // same points every run
+
+    bool ok = true;
+    for(int n: {10, 100, 1000, 10000}){
+        ok = benchHitTest(n) && ok;
+    }
+
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy"); // no display needed
+    if( SDL_Init( SDL_INIT_VIDEO ) < 0 || !( IMG_Init( IMG_INIT_PNG ) & IMG_INIT_PNG ) ){
+        cerr << "SDL error: " << SDL_GetError() << endl;
+        return 1;
+    }
+    SDL_Surface* screen = SDL_CreateRGBSurfaceWithFormat(0, 1200, 900, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = SDL_CreateSoftwareRenderer(screen);
+    if(!renderer){
+        cerr << "SDL error: " << SDL_GetError() << endl;
+        return 1;
+    }
+    ImageLoader::setRenderer(renderer);
+    cout.rdbuf(nullptr); // silence the editor's logging
+    Log::setLevel(Log::ERR); // and do not even format debug messages
+
+    reportNodeSize<Operator>("Operator", Operator::UNION);
+    reportNodeSize<Shape>("Shape", Shape::CUBE);
+    reportNodeSize<Modifier>("Modifier", Modifier::TRANSLATE);
+    ok = benchDesign(renderer) && ok;
+    ok = benchLoad() && ok;
+    ok = benchHistory() && ok;
+    ok = benchModuleImages() && ok;
+    benchLog();
+    ok = benchProfiler() && ok;
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(screen);
+    IMG_Quit();
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include "csg.h"
+using namespace std;
+
+typedef shared_ptr<CsgNode> NodePtr;
+const double PI = 3.14159265358979323846;
+const double FAR = numeric_limits<double>::max();
+
+struct Vec {
+    double x, y, z;
+    Vec(double X=0, double Y=0, double Z=0): x(X), y(Y), z(Z) {}
+    Vec operator+(const Vec& v) const { return Vec(x+v.x, y+v.y, z+v.z); }
+    Vec operator-(const Vec& v) const { return Vec(x-v.x, y-v.y, z-v.z); }
+    Vec operator*(double d) const { return Vec(x*d, y*d, z*d); }
+    double dot(const Vec& v) const { return x*v.x + y*v.y + z*v.z; }
+    Vec cross(const Vec& v) const { return Vec(y*v.z-z*v.y, z*v.x-x*v.z, x*v.y-y*v.x); }
+    double length() const { return sqrt(dot(*this)); }
+    Vec normalized() const { double l = length(); return l > 0 ? *this*(1/l) : *this; }
+};
+
+static Vec multiply(const double m[3][3], const Vec& v){
+    return Vec(m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+               m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+               m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z);
+}
+
+// modifier waiting for the object it applies to.  matrix maps child's coordinates to ours
+static NodePtr transform(const double matrix[3][3], const Vec& offset){
+    auto node = make_shared<CsgNode>(CsgNode::TRANSFORM);
+    copy(&matrix[0][0], &matrix[0][0]+9, &node->matrix[0][0]);
+    double det = matrix[0][0]*(matrix[1][1]*matrix[2][2] - matrix[1][2]*matrix[2][1])
+               - matrix[0][1]*(matrix[1][0]*matrix[2][2] - matrix[1][2]*matrix[2][0])
+               + matrix[0][2]*(matrix[1][0]*matrix[2][1] - matrix[1][1]*matrix[2][0]);
+    for(int r = 0; r < 3; ++r){ // inverse is the transposed matrix of cofactors divided by det
+        for(int c = 0; c < 3; ++c){
+            int r1 = (c+1)%3, r2 = (c+2)%3, c1 = (r+1)%3, c2 = (r+2)%3;
+            node->inverse[r][c] = (matrix[r1][c1]*matrix[r2][c2] - matrix[r1][c2]*matrix[r2][c1]) / det;
+        }
+    }
+    node->offset[0] = offset.x;
+    node->offset[1] = offset.y;
+    node->offset[2] = offset.z;
+    return node;
+}
+
+void CsgBuilder::add(NodePtr node){
+    for(auto it = modifiers.rbegin(); it != modifiers.rend(); ++it){ // last modifier is the closest to the object
+        (*it)->children.assign(1, node);
+        node = *it;
+    }
+    modifiers.clear();
+    nodes.push_back(node);
+}
+
+void CsgBuilder::translate(double x, double y, double z){
+    const double identity[3][3] = {{1,0,0},{0,1,0},{0,0,1}};
+    modifiers.push_back( transform(identity, Vec(x,y,z)) );
+}
+
+void CsgBuilder::rotate(double x, double y, double z){
+    double cx = cos(x*PI/180), sx = sin(x*PI/180);
+    double cy = cos(y*PI/180), sy = sin(y*PI/180);
+    double cz = cos(z*PI/180), sz = sin(z*PI/180);
+    const double m[3][3] = { // Rz * Ry * Rx
+        {cz*cy, cz*sy*sx - sz*cx, cz*sy*cx + sz*sx},
+        {sz*cy, sz*sy*sx + cz*cx, sz*sy*cx - cz*sx},
+        {-sy,   cy*sx,            cy*cx}
+    };
+    modifiers.push_back( transform(m, Vec()) );
+}
+
+void CsgBuilder::scale(double x, double y, double z){
+    const double TINY = 1e-6; // flat objects are rendered very thin
+    x = fabs(x) < TINY ? TINY : x;
+    y = fabs(y) < TINY ? TINY : y;
+    z = fabs(z) < TINY ? TINY : z;
+    const double m[3][3] = {{x,0,0},{0,y,0},{0,0,z}};
+    auto node = transform(m, Vec());
+    node->scale = min(fabs(x), min(fabs(y), fabs(z))); // distances shrink by at most this
+    modifiers.push_back(node);
+}
+
+
+// signed distance from p to the surface of node.  Negative inside
+static double distance(const CsgNode& node, const Vec& p){
+    switch(node.type){
+        case CsgNode::CUBE: {
+            Vec q(fabs(p.x) - fabs(node.size[0])/2, fabs(p.y) - fabs(node.size[1])/2, fabs(p.z) - fabs(node.size[2])/2);
+            Vec out(max(q.x,0.0), max(q.y,0.0), max(q.z,0.0));
+            return out.length() + min(max(q.x, max(q.y, q.z)), 0.0);
+        }
+        case CsgNode::CYLINDER: { // capped cone along z.  r1 at the bottom, r2 at the top
+            double h = fabs(node.size[0])/2, r1 = fabs(node.size[1])/2, r2 = fabs(node.size[2])/2;
+            double qx = sqrt(p.x*p.x + p.y*p.y), qy = p.z;
+            double k2x = r2-r1, k2y = 2*h;
+            double cax = qx - min(qx, qy < 0 ? r1 : r2), cay = fabs(qy) - h;
+            double k2len = k2x*k2x + k2y*k2y;
+            double t = k2len > 0 ? max(0.0, min(1.0, ((r2-qx)*k2x + (h-qy)*k2y) / k2len)) : 0;
+            double cbx = qx - r2 + k2x*t, cby = qy - h + k2y*t;
+            double s = (cbx < 0 && cay < 0) ? -1 : 1;
+            return s*sqrt( min(cax*cax + cay*cay, cbx*cbx + cby*cby) );
+        }
+        case CsgNode::SPHERE:
+            return p.length() - fabs(node.size[0])/2;
+        case CsgNode::UNION: {
+            double d = FAR;
+            for(auto& c: node.children){ d = min(d, distance(*c, p)); }
+            return d;
+        }
+        case CsgNode::DIFFERENCE: { // first child minus the rest
+            if(node.children.empty()){ return FAR; }
+            double d = distance(*node.children[0], p);
+            for(size_t i = 1; i < node.children.size(); ++i){ d = max(d, -distance(*node.children[i], p)); }
+            return d;
+        }
+        case CsgNode::INTERSECTION: {
+            if(node.children.empty()){ return FAR; }
+            double d = -FAR;
+            for(auto& c: node.children){ d = max(d, distance(*c, p)); }
+            return d;
+        }
+        case CsgNode::TRANSFORM: {
+            if(node.children.empty()){ return FAR; }
+            Vec q = multiply(node.inverse, p - Vec(node.offset[0], node.offset[1], node.offset[2]));
+            double d = distance(*node.children[0], q);
+            return d == FAR ? FAR : d*node.scale;
+        }
+    }
+    return FAR;
+}
+
+// axis aligned box around node.  Returns false if node is empty
+static bool bounds(const CsgNode& node, Vec& lo, Vec& hi){
+    switch(node.type){
+        case CsgNode::CUBE:
+            hi = Vec(fabs(node.size[0])/2, fabs(node.size[1])/2, fabs(node.size[2])/2);
+            lo = hi*-1;
+            return true;
+        case CsgNode::CYLINDER: {
+            double r = max(fabs(node.size[1]), fabs(node.size[2]))/2;
+            hi = Vec(r, r, fabs(node.size[0])/2);
+            lo = hi*-1;
+            return true;
+        }
+        case CsgNode::SPHERE: {
+            double r = fabs(node.size[0])/2;
+            hi = Vec(r, r, r);
+            lo = hi*-1;
+            return true;
+        }
+        case CsgNode::DIFFERENCE: // result is within the first child
+            return !node.children.empty() && bounds(*node.children[0], lo, hi);
+        case CsgNode::UNION:
+        case CsgNode::INTERSECTION: { // union of children is big enough for intersection too
+            bool found = false;
+            for(auto& c: node.children){
+                Vec l, h;
+                if(!bounds(*c, l, h)){ continue; }
+                lo = found ? Vec(min(lo.x,l.x), min(lo.y,l.y), min(lo.z,l.z)) : l;
+                hi = found ? Vec(max(hi.x,h.x), max(hi.y,h.y), max(hi.z,h.z)) : h;
+                found = true;
+            }
+            return found;
+        }
+        case CsgNode::TRANSFORM: {
+            Vec l, h;
+            if(node.children.empty() || !bounds(*node.children[0], l, h)){ return false; }
+            Vec offset(node.offset[0], node.offset[1], node.offset[2]);
+            for(int i = 0; i < 8; ++i){ // corners of child's box
+                Vec corner = multiply(node.matrix, Vec(i&1 ? h.x : l.x, i&2 ? h.y : l.y, i&4 ? h.z : l.z)) + offset;
+                lo = i ? Vec(min(lo.x,corner.x), min(lo.y,corner.y), min(lo.z,corner.z)) : corner;
+                hi = i ? Vec(max(hi.x,corner.x), max(hi.y,corner.y), max(hi.z,corner.z)) : corner;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+SDL_Surface* renderCsg(const vector<NodePtr>& nodes, int width, int height){
+    CsgNode scene(CsgNode::UNION);
+    scene.children = nodes;
+    Vec lo, hi;
+    if(!bounds(scene, lo, hi)){ return nullptr; }
+    Vec center = (lo + hi)*0.5;
+    double radius = max((hi - lo).length()/2, 1e-3);
+
+    // orthographic camera looking at the center from the same side as openscad's default view
+    Vec eye = Vec(0.5, -1.0, 0.7).normalized();
+    Vec view = eye*-1;
+    Vec right = view.cross(Vec(0,0,1)).normalized();
+    Vec up = right.cross(view);
+    Vec light = (eye + up*0.5 + right*0.3).normalized();
+    double pixel = 2.1*radius / min(width, height);
+    double eps = radius*1e-3;
+    const int MAX_STEPS = 128;
+
+    vector<Uint32> pixels(width*height);
+    auto renderRows = [&](int first, int step){
+        for(int y = first; y < height; y += step){
+            for(int x = 0; x < width; ++x){
+                Vec origin = center + eye*(2*radius) + right*((x - width/2.0)*pixel) + up*((height/2.0 - y)*pixel);
+                Uint32 color = 0xFFFFFFE5; // openscad's background
+                double t = 0;
+                for(int i = 0; i < MAX_STEPS && t < 4*radius; ++i){
+                    Vec p = origin + view*t;
+                    double d = distance(scene, p);
+                    if(d < eps){ // hit.  Shade by the angle between the light and the surface normal
+                        Vec n = Vec(distance(scene, p+Vec(eps,0,0)) - distance(scene, p-Vec(eps,0,0)),
+                                    distance(scene, p+Vec(0,eps,0)) - distance(scene, p-Vec(0,eps,0)),
+                                    distance(scene, p+Vec(0,0,eps)) - distance(scene, p-Vec(0,0,eps))).normalized();
+                        double shade = 0.35 + 0.65*max(0.0, n.dot(light));
+                        color = 0xFF000000 | Uint32(249*shade) << 16 | Uint32(215*shade) << 8 | Uint32(44*shade);
+                        break;
+                    }
+                    t += max(d, eps);
+                }
+                pixels[y*width + x] = color;
+            }
+        }
+    };
+    int threads = max(1u, min(8u, thread::hardware_concurrency()));
+    vector<thread> workers;
+    for(int i = 1; i < threads; ++i){ workers.emplace_back(renderRows, i, threads); }
+    renderRows(0, threads);
+    for(auto& w: workers){ w.join(); }
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if(!surface){ return nullptr; }
+    for(int y = 0; y < height; ++y){
+        copy(&pixels[y*width], &pixels[y*width] + width, (Uint32*)((Uint8*)surface->pixels + y*surface->pitch));
+    }
+    return surface;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <vector>
+#include <memory>
+
+// Constructive solid geometry tree made from Objects by Object::saveCsg()
+// It is rendered by the built-in previewer which ray-marches signed distance functions.
+struct CsgNode {
+    enum Type {CUBE, CYLINDER, SPHERE, UNION, DIFFERENCE, INTERSECTION, TRANSFORM} type;
+    double size[3] = {0,0,0}; // cube([x,y,z]), cylinder(h,d1,d2), sphere(d) in size[0]
+    double matrix[3][3];      // TRANSFORM: child's coordinates are mapped to ours by matrix and then offset is added
+    double inverse[3][3];     // TRANSFORM: inverse of matrix
+    double offset[3] = {0,0,0};
+    double scale = 1;         // TRANSFORM: child's distances are multiplied by it
+    std::vector<std::shared_ptr<CsgNode>> children;
+    CsgNode(Type t): type(t) {}
+};
+
+// Collects CsgNodes the same way openscad reads the code generated by saveScad():
+// a modifier such as translate() applies to the object following it.
+class CsgBuilder {
+    std::vector<std::shared_ptr<CsgNode>> modifiers; // waiting for the next object
+public:
+    std::vector<std::shared_ptr<CsgNode>> nodes;
+    int depth = 0; // module calls nested in modules.  Used to stop on cycles
+    void add(std::shared_ptr<CsgNode> node); // applies waiting modifiers to node
+    void translate(double x, double y, double z);
+    void rotate(double x, double y, double z); // degrees.  Same order as openscad: x first, then y, then z
+    void scale(double x, double y, double z);
+};
+
+// renders a shaded image of the union of nodes.  Returns nullptr if there is nothing to render
+SDL_Surface* renderCsg(const std::vector<std::shared_ptr<CsgNode>>& nodes, int width, int height);
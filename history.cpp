@@ -0,0 +1,148 @@
+#include <deque>
+#include <memory>
+#include <vector>
+#include "history.h"
+#include "object.h"
+#include "log.h"
+using namespace std;
+
+struct Edit {
+    enum Type {INSERT, ERASE, VALUE, MODULE} type;
+    shared_ptr<Object> target; // FlowLayout, Input or Operator.  Keeps it alive
+    shared_ptr<Object> obj;    // inserted or erased object or the new Module
+    size_t index;              // or module id
+    double oldValue, newValue; // or the last module id before the module was made
+};
+typedef vector<Edit> Step;
+
+static deque<Step> undoStack, redoStack;
+static bool enabled = false;
+static bool applying = false; // edits made by undo() and redo() are not recorded
+static bool grouping = false, groupStarted = false; // between begin() and end().  Step was added
+static bool mergeValues = false; // next change of the last Input goes into the last step
+
+static void record(Edit&& e){
+    if(!enabled || applying){ return; }
+    redoStack.clear();
+    if(!grouping || !groupStarted){
+        undoStack.emplace_back();
+        groupStarted = grouping;
+        if(undoStack.size() > History::MAX_STEPS){ undoStack.pop_front(); }
+    }
+    undoStack.back().push_back(move(e));
+}
+
+void History::setEnabled(bool on){
+    enabled = on;
+}
+
+void History::inserted(FlowLayout& layout, size_t index, shared_ptr<Object> const & obj){
+    if(!enabled || applying){ return; }
+    mergeValues = false;
+    record({Edit::INSERT, layout.self(), obj, index, 0, 0});
+}
+
+void History::erased(FlowLayout& layout, size_t index, shared_ptr<Object> const & obj){
+    if(!enabled || applying){ return; }
+    mergeValues = false;
+    record({Edit::ERASE, layout.self(), obj, index, 0, 0});
+}
+
+void History::valueChanged(Input& input, double oldValue, double newValue){
+    if(!enabled || applying){ return; }
+    if(mergeValues && !undoStack.empty()){
+        Edit& last = undoStack.back().back();
+        if(Edit::VALUE == last.type && last.target.get() == &input){ // wheel keeps turning
+            last.newValue = newValue;
+            redoStack.clear();
+            return;
+        }
+    }
+    record({Edit::VALUE, input.self(), nullptr, 0, oldValue, newValue});
+    mergeValues = true;
+}
+
+void History::moduleMade(Operator& op, shared_ptr<Module> const & module, int lastId){
+    if(!enabled || applying){ return; }
+    mergeValues = false;
+    record({Edit::MODULE, op.self(), module, size_t(op.getModuleId()), double(lastId), 0});
+}
+
+void History::begin(){
+    grouping = true;
+    groupStarted = false;
+    mergeValues = false;
+}
+
+void History::end(){
+    grouping = groupStarted = false;
+    mergeValues = false;
+}
+
+static void apply(const Edit& e, bool forward){
+    switch(e.type){
+        case Edit::INSERT:
+        case Edit::ERASE: {
+            auto layout = static_cast<FlowLayout*>(e.target.get());
+            auto obj = e.obj;
+            if((Edit::INSERT == e.type) == forward){
+                layout->insertObject(obj, e.index);
+            } else {
+                layout->removeChild(obj);
+            }
+            break;
+        }
+        case Edit::VALUE:
+            static_cast<Input*>(e.target.get())->setValue(forward ? e.newValue : e.oldValue);
+            break;
+        case Edit::MODULE: {
+            auto op = static_cast<Operator*>(e.target.get());
+            if(forward){
+                op->restoreModule(static_pointer_cast<Module>(e.obj), int(e.index));
+            } else {
+                op->removeModule(int(e.oldValue));
+            }
+            break;
+        }
+    }
+}
+
+bool History::undo(){
+    if(undoStack.empty()){ return false; }
+    end();
+    applying = true;
+    Step& step = undoStack.back();
+    for(auto it = step.rbegin(); it != step.rend(); ++it){ apply(*it, false); } // last edit first
+    applying = false;
+    redoStack.push_back(move(step));
+    undoStack.pop_back();
+    LOG_DEBUG("Undo.  " << undoStack.size() << " steps left");
+    return true;
+}
+
+bool History::redo(){
+    if(redoStack.empty()){ return false; }
+    end();
+    applying = true;
+    Step& step = redoStack.back();
+    for(auto& e: step){ apply(e, true); }
+    applying = false;
+    undoStack.push_back(move(step));
+    redoStack.pop_back();
+    LOG_DEBUG("Redo.  " << redoStack.size() << " steps left");
+    return true;
+}
+
+void History::clear(){
+    undoStack.clear();
+    redoStack.clear();
+    end();
+}
+
+size_t History::undoSteps(){
+    return undoStack.size();
+}
+
+size_t History::redoSteps(){
+    return redoStack.size();
+}
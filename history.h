@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+class Object;
+class FlowLayout;
+class Input;
+class Operator;
+class Module;
+
+// Undo and redo of edits of the tree: objects added to or removed from layouts, Input values and
+// Operators turned into modules (by dropping them on Labels or on the view).
+// Edits are logged as they happen.  A step keeps only the objects it added or removed.  They are shared
+// with the tree, not copied, so memory and undo time depend on the size of the edit and not of the design.
+// Edits between begin() and end() are one step, for example taking an object and dropping it somewhere else.
+// Changes of the same Input one after another are also one step.
+// Nothing is recorded until setEnabled(true) so that building the GUI and loading files can not be undone.
+class History {
+public:
+    static const size_t MAX_STEPS = 1000; // older steps are forgotten
+    static void setEnabled(bool on);
+    static void inserted(FlowLayout& layout, size_t index, std::shared_ptr<Object> const & obj); // by FlowLayout
+    static void erased(FlowLayout& layout, size_t index, std::shared_ptr<Object> const & obj);
+    static void valueChanged(Input& input, double oldValue, double newValue); // by Input::setValue()
+    static void moduleMade(Operator& op, std::shared_ptr<Module> const & module, int lastId); // by Operator::setModuleId()
+    static void begin(); // edits until end() are undone together
+    static void end();
+    static bool undo(); // returns false if there is nothing to undo
+    static bool redo();
+    static void clear();
+    static size_t undoSteps();
+    static size_t redoSteps();
+};
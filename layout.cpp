@@ -3,112 +3,197 @@
 #include <iostream>
 #include "misc.h"
 #include "object.h"
+#include "csg.h"
+#include "profile.h"
+#include "log.h"
+#include "render.h"
+#include "history.h"
 using namespace std;
 
 
-void FlowLayout::setLocation(const Point& xy){
-    Object::setLocation(xy);
+// redraw old and new area if a container moved or changed its size
+static void invalidateChange(const SDL_Rect& old, Object& obj){
+    if(old.x==obj.loc.x && old.y==obj.loc.y && old.w==obj.loc.w && old.h==obj.loc.h){ return; }
+    Damage::add(old);
+    Damage::add(obj.loc); // retained images are redrawn if the size changed
+    obj.geometryChanged();
+}
+
+const size_t GRID_MIN_CHILDREN = 32; // linear search is faster for fewer children
+
+void FlowLayout::updateGeometry(int first, int end){
+    if(!geometryDirty){ return; }
+    rects.resize(children.size());
+    for(int i = first; i < end && i < (int)children.size(); ++i){ rects.set(i, children[i]->loc); }
+    geometryDirty = false;
+}
+
+const vector<int>& FlowLayout::childrenAt(const Point& xy){
+    if(children.size() < GRID_MIN_CHILDREN){
+        updateGeometry(0, children.size());
+        rects.query(xy, 0, children.size(), hits);
+        Profiler::count(Profiler::HIT_TEST_NODES, children.size());
+        return hits;
+    }
+    if(gridDirty){ // some children moved since last time
+        vector<SDL_Rect> locs;
+        locs.reserve(children.size());
+        for(auto& c: children){ locs.push_back(c->loc); }
+        grid.build(locs);
+        gridDirty = false;
+    }
+    Profiler::count(Profiler::HIT_TEST_NODES, grid.query(xy, hits));
+    return hits;
+}
+
+int FlowLayout::flow(const Point& xy, bool place){
     Point next = xy;
     int rowHeight = 0;
     for(auto& objPtr: children){
-        rowHeight = max(rowHeight, objPtr->loc.h);
         int xmax = next.x+objPtr->loc.w;
-        if(xmax-2 > loc.x+loc.w){ // falls off the screen on the right
+        if(!autoWidth && next.x != xy.x && xmax-2 > xy.x+loc.w){ // falls off the screen on the right
             next.x = xy.x;
             next.y = next.y+rowHeight;
-            rowHeight = objPtr->loc.h;
+            rowHeight = 0;
         }
-        objPtr->setLocation(next);
+        rowHeight = max(rowHeight, objPtr->loc.h);
+        if(place){ objPtr->setLocation(next); }
         next.x += objPtr->loc.w;
     }
-    loc.h = (next.y - xy.y)+rowHeight; // if it increased in size 
-//    cout << "HLayout setting location at ("<< xy.x << ","<<xy.y<<") size (" << loc.w << "," << loc.h << ")" << endl;
-    cout << '_';
+    if(autoWidth){ loc.w = next.x - xy.x; }
+    return (next.y - xy.y)+rowHeight;
+}
+
+void FlowLayout::measure(){
+    if(!sizeDirty){ return; }
+    for(auto& objPtr: children){
+        objPtr->measure();
+    }
+    loc.h = flow(Point(0,0), false);
+    sizeDirty = false;
+}
+
+void FlowLayout::setLocation(const Point& xy){
+    if(!layoutDirty && xy.x == loc.x && xy.y == loc.y){ return; } // children did not change
+    PROFILE("FlowLayout::setLocation");
+    Profiler::count(Profiler::LAYOUT_PASSES);
+    SDL_Rect old = loc;
+    measure();
+    Object::setLocation(xy);
+    flow(xy, true);
+    invalidateChange(old, *this);
+    LOG_DEBUG("HLayout setting location at (" << xy.x << "," << xy.y << ") size (" << loc.w << "," << loc.h << ")");
 }
 
 bool FlowLayout::saveScad(ostream& file){
     for(auto& o: children){
-        o->saveScad(file);
+        o->writeScad(file);
     }
     return true;
 }
 
-void FlowLayout::addObject(shared_ptr<Object>const & obj){
+void FlowLayout::saveCsg(CsgBuilder& csg){
+    for(auto& o: children){
+        o->saveCsg(csg);
+    }
+}
+
+void FlowLayout::insertObject(shared_ptr<Object>const & obj, size_t index){
     if( find(begin(children), end(children), obj) != end(children) ) { return; } // duplicate
-    children.push_back(obj);
+    index = min(index, children.size());
+    History::inserted(*this, index, obj);
+    children.insert(begin(children) + index, obj);
+    obj->container = this;
+    geometryDirty = gridDirty = true;
+    layoutChanged();
+    invalidate();
+    scadChanged();
+}
+
+// all children are removed through here
+vector<shared_ptr<Object>>::iterator FlowLayout::eraseChild(vector<shared_ptr<Object>>::iterator it){
+    History::erased(*this, it - begin(children), *it);
+    if((*it)->container == this){ (*it)->container = nullptr; }
+    geometryDirty = gridDirty = true;
+    layoutChanged();
+    invalidate();
+    scadChanged();
+    return children.erase(it);
 }
 
 bool FlowLayout::removeChild(shared_ptr<Object>& obj){
     auto it = find(begin(children), end(children), obj);
     if(end(children) == it) { return false; }
-    children.erase(it);
+    eraseChild(it);
     return true;
 }
 
+// draws the outline of a layout
+static void drawFrame(SDL_Renderer* rend, Object& obj){
+    RenderBatch::outline(obj.loc, obj.draggedOver);
+}
+
 void FlowLayout::draw(SDL_Renderer* rend){
-    for(auto& objPtr: children){
-        objPtr->draw(rend);
-    }
-    if(draggedOver){
-        SDL_SetRenderDrawColor(rend,255,0,0,255);
-    } else {
-        SDL_SetRenderDrawColor(rend,255,255,255,255);
+    if(drawRetained(rend)){ return; }
+    PROFILE("FlowLayout::draw");
+    SDL_Rect clip; // only the damaged area is being redrawn
+    if(!RenderBatch::getClip(rend, clip)){
+        for(auto& objPtr: children){ objPtr->draw(rend); }
+        drawFrame(rend, *this);
+        return;
     }
-    SDL_RenderDrawRect(rend, &loc);
+    updateGeometry(0, children.size());
+    rects.overlapping(clip, 0, children.size(), drawn);
+    for(int i: drawn){ children[i]->draw(rend); }
+    drawFrame(rend, *this);
 }
 
 shared_ptr<Object> FlowLayout::takeObject(const Point& xy){
-    for(auto it = begin(children); it!=end(children); ++it ){
-        if(xy.inRectangle((*it)->loc)){
-            auto obj = (*it)->takeObject(xy); // take from its children
-            if(obj){
-//                if(*it == obj){ // it is the child itself
-//                    children.erase(it);
-//                }
-                cout << "Removing an object from one of the children. children size=" << children.size() <<endl;
-                setLocation(Point(loc.x, loc.y)); // perform layout
-                return obj;
-            }
-            if(disableDragDrop){ return shared_ptr<Object>(); }
-            auto ptr = (*it);
-            cout << "Removing Object.  Children size=" << children.size() << endl;
-            children.erase(it);
-            cout << "Revoved Object.  Children size=" << children.size() << endl;
-            setLocation(Point(loc.x, loc.y)); // perform layout
-            return ptr;
-        }
+    const vector<int>& hit = childrenAt(xy);
+    if(hit.empty()){ return shared_ptr<Object>(); }
+    auto it = begin(children) + hit.front();
+    auto obj = (*it)->takeObject(xy); // take from its children
+    if(obj){
+//        if(*it == obj){ // it is the child itself
+//            children.erase(it);
+//        }
+        LOG_DEBUG("Removing an object from one of the children. children size=" << children.size());
+        setLocation(Point(loc.x, loc.y)); // perform layout
+        return obj;
     }
-    return shared_ptr<Object>();
+    if(disableDragDrop){ return shared_ptr<Object>(); }
+    auto ptr = (*it);
+    LOG_DEBUG("Removing Object.  Children size=" << children.size());
+    eraseChild(it);
+    LOG_DEBUG("Removed Object.  Children size=" << children.size());
+    setLocation(Point(loc.x, loc.y)); // perform layout
+    return ptr;
 }
 
 bool FlowLayout::dropped(const Point& xy, shared_ptr<Object>const & obj){
     if( ! xy.inRectangle(loc)){ return false; }
-    for(auto& o: children){
-        if(xy.inRectangle(o->loc)){
-            if(o->dropped(xy,obj) ){
-                setLocation(Point(loc.x,loc.y)); // perform layout
-                cout << "Added an object to one of the children." << endl;
-                return true;
-//            } else {
-//                return false;
-            }
+    for(int i: vector<int>(childrenAt(xy)) ){ // copy since children can change
+        if(children[i]->dropped(xy,obj) ){
+            setLocation(Point(loc.x,loc.y)); // perform layout
+            LOG_DEBUG("Added an object to one of the children.");
+            return true;
+//        } else {
+//            return false;
         }
     }
     if(disableDragDrop){ return false; }
     if( end(children) == find(begin(children), end(children), obj)) {
         addObject(obj);
-        cout << "Added an object. children size=" << children.size() << endl;
+        LOG_DEBUG("Added an object. children size=" << children.size());
     }
     setLocation(Point(loc.x,loc.y)); // perform layout
     return true;
 }
 
 std::shared_ptr<Object> FlowLayout::click(const Point& xy){
-    for(auto& c: children){
-        if(xy.inRectangle(c->loc)){
-            auto o = c->click(xy);
-            if(o){ return o; }
-        }
+    for(int i: vector<int>(childrenAt(xy)) ){
+        auto o = children[i]->click(xy);
+        if(o){ return o; }
     }
     // Flow Layout should never be in focus because it does not respond to mouse wheel events
     // TODO for vertical layout !!!
@@ -116,31 +201,91 @@ std::shared_ptr<Object> FlowLayout::click(const Point& xy){
 }
 
 std::shared_ptr<Object> FlowLayout::clickr(const Point& xy){
-    for(auto& c: children){
-        if(xy.inRectangle(c->loc)){
-            auto o = c->clickr(xy);
-            if(o){ return o; }
-        }
+    for(int i: vector<int>(childrenAt(xy)) ){
+        auto o = children[i]->clickr(xy);
+        if(o){ return o; }
     }
     return shared_ptr<Object>();
 }
 
+void FlowLayout::scroll(const Point& xy, int y){
+    for(int i: vector<int>(childrenAt(xy)) ){
+        children[i]->scroll(xy, y);
+    }
+}
+
 
 /*************************************************************************/
+const int SCROLL_STEP = ITEM_HEIGHT/3; // pixels per mouse wheel click
+
 void VerticalLayout::scroll(const Point& xy, int y){
-    cout << y << " ";
-    cout.flush();
+    if( !xy.inRectangle(loc) ){ return; }
+    int maxScroll = max(0, tops.back() - loc.h);
+    if(0 == maxScroll){ // everything fits.  Maybe one of the children can scroll
+        FlowLayout::scroll(xy, y);
+        return;
+    }
+    int s = min(maxScroll, max(0, scrollY - y*SCROLL_STEP));
+    if(s == scrollY){ return; }
+    scrollY = s;
+    layoutDirty = true;
+    setLocation(Point(loc.x, loc.y));
+    invalidate();
+}
+
+void VerticalLayout::measure(){ // size is fixed
+    if(!sizeDirty){ return; }
+    tops.assign(1, 0);
+    for(auto& objPtr: children){
+        objPtr->measure();
+        tops.push_back(tops.back() + objPtr->loc.h);
+    }
+    sizeDirty = false;
 }
 
 void VerticalLayout::setLocation(const Point& xy){
+    if(!layoutDirty && xy.x == loc.x && xy.y == loc.y){ return; } // children did not change
+    PROFILE("VerticalLayout::setLocation");
+    Profiler::count(Profiler::LAYOUT_PASSES);
+    SDL_Rect old = loc;
+    measure();
     Object::setLocation(xy);
-    Point next = xy;
-    for(auto& objPtr: children){
-        objPtr->setLocation(next);
-        next.y+= objPtr->loc.h;
+    scrollY = min(scrollY, max(0, tops.back() - loc.h)); // content might have shrunk
+    auto last = tops.end()-1; // children are tops[0] ... tops[n-1]
+    firstVisible = max(0, int(upper_bound(tops.begin(), last, scrollY) - tops.begin()) - 1);
+    endVisible = lower_bound(tops.begin(), last, scrollY + loc.h) - tops.begin();
+    for(int i = firstVisible; i < endVisible; ++i){
+        children[i]->setLocation( Point(xy.x, xy.y + tops[i] - scrollY) );
+    }
+    geometryDirty = true; // children that became visible might not have moved
+    invalidateChange(old, *this);
+    LOG_DEBUG("VLayout setting location at (" << xy.x << "," << xy.y << ") size (" << loc.w << "," << loc.h << ")");
+}
+
+void VerticalLayout::draw(SDL_Renderer* rend){
+    if(drawRetained(rend)){ return; }
+    PROFILE("VerticalLayout::draw");
+    SDL_Rect clip = loc; // children partially scrolled out should not draw over other objects
+    SDL_Rect oldClip;
+    bool clipped = RenderBatch::getClip(rend, oldClip);
+    if(clipped){
+        if( !SDL_IntersectRect(&oldClip, &loc, &clip) ){ return; } // this layout is not damaged
     }
-//    cout << "VLayout setting location at ("<< xy.x << ","<<xy.y<<") size (" << loc.w << "," << loc.h << ")" << endl;
-    cout << '|';
+    RenderBatch::setClip(rend, &clip); // draws what was batched with the old clip
+    updateGeometry(firstVisible, endVisible);
+    rects.overlapping(clip, firstVisible, endVisible, drawn);
+    for(int i: drawn){ children[i]->draw(rend); }
+    RenderBatch::setClip(rend, clipped ? &oldClip : NULL);
+    drawFrame(rend, *this);
+}
+
+const vector<int>& VerticalLayout::childrenAt(const Point& xy){
+    hits.clear();
+    if( !xy.inRectangle(loc) ){ return hits; } // children scrolled out are not clickable
+    updateGeometry(firstVisible, endVisible);
+    rects.query(xy, firstVisible, endVisible, hits);
+    Profiler::count(Profiler::HIT_TEST_NODES, endVisible - firstVisible);
+    return hits;
 }
 
 
@@ -148,13 +293,13 @@ bool Labels::dropped(const Point& xy, shared_ptr<Object>const & obj){
     auto op = dynamic_pointer_cast<Operator>(obj);
     if(!op || !op->isClone){
         setLocation(Point(loc.x, loc.y));
-        cout << "Object is not an operator." << endl;
+        LOG_DEBUG("Object is not an operator.");
         return false; 
     }
     auto module = op->getModule();
     if( end(children) == find(begin(children), end(children), module)) {
         addObject(module);
-        cout << "Added a label to Labels at "<< loc.x << "," << loc.y << endl;
+        LOG_DEBUG("Added a label to Labels at "<< loc.x << "," << loc.y);
     }
     setLocation(Point(loc.x, loc.y));
     return true;
@@ -162,32 +307,29 @@ bool Labels::dropped(const Point& xy, shared_ptr<Object>const & obj){
 
 
 shared_ptr<Object> Labels::takeObject(const Point& xy){
-    for(auto& c: children){
-        if(xy.inRectangle(c->loc)){
-            auto obj = c;
-            children.erase( remove(begin(children), end(children), c), end(children) );
-            return obj;
-        }
-    }
-    return shared_ptr<Object>();
+    const vector<int>& hit = childrenAt(xy);
+    if(hit.empty()){ return shared_ptr<Object>(); }
+    auto obj = children[hit.front()];
+    eraseChild(begin(children) + hit.front());
+    return obj;
 }
 
 
 bool Main::dropped(const Point& xy, shared_ptr<Object>const & obj){
-    for(auto& o: children){
-        if(xy.inRectangle(o->loc) && o->dropped(xy,obj) ){
+    for(int i: vector<int>(childrenAt(xy)) ){
+        if( children[i]->dropped(xy,obj) ){
             setLocation(Point(loc.x, loc.y));
             return true;
         }
     }
     auto op = dynamic_pointer_cast<Operator>(obj);
     if(!op){
-        cout << "Object is not an operator." << endl;
+        LOG_DEBUG("Object is not an operator.");
         return false;
     }
     if( end(children) == find(begin(children), end(children), obj)) {
         addObject(obj);
-        cout << "Added an Operator to Main." << endl;
+        LOG_DEBUG("Added an Operator to Main.");
     }
     setLocation(Point(loc.x, loc.y));
     return true;
@@ -0,0 +1,378 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include "loader.h"
+#include "object.h"
+#include "log.h"
+using namespace std;
+
+
+// points into the file.  Nothing is copied
+struct Token {
+    enum Type {END, IDENT, NUMBER, PUNCT} type = END;
+    const char* text = "";
+    int len = 0;
+    int line = 0;
+    bool is(const char* str) const { return (int)strlen(str) == len && 0 == strncmp(text, str, len); }
+    bool is(char c) const { return PUNCT == type && text[0] == c; }
+    string str() const { return string(text, len); }
+};
+
+class Tokenizer {
+    const char* p;
+    const char* end;
+    int line = 1;
+public:
+    Tokenizer(const char* begin, const char* enD): p(begin), end(enD) {}
+    Token next(){
+        while(p < end){ // skip white space and comments
+            if('\n' == *p){
+                ++line;
+                ++p;
+            } else if(isspace((unsigned char)*p)){
+                ++p;
+            } else if('/' == *p && p+1 < end && '/' == p[1]){
+                while(p < end && '\n' != *p){ ++p; }
+            } else if('/' == *p && p+1 < end && '*' == p[1]){
+                for(p += 2; p+1 < end && !('*' == *p && '/' == p[1]); ++p){
+                    if('\n' == *p){ ++line; }
+                }
+                p = min(end, p+2);
+            } else {
+                break;
+            }
+        }
+        Token t;
+        t.text = p;
+        t.line = line;
+        if(p >= end){ return t; }
+        if(isalpha((unsigned char)*p) || '_' == *p || '$' == *p){
+            t.type = Token::IDENT;
+            while(p < end && (isalnum((unsigned char)*p) || '_' == *p || '$' == *p)){ ++p; }
+        } else if(isdigit((unsigned char)*p) || '.' == *p){
+            t.type = Token::NUMBER;
+            while(p < end && (isdigit((unsigned char)*p) || '.' == *p)){ ++p; }
+            if(p < end && ('e' == *p || 'E' == *p)){ // exponent such as 1e+06
+                ++p;
+                if(p < end && ('+' == *p || '-' == *p)){ ++p; }
+                while(p < end && isdigit((unsigned char)*p)){ ++p; }
+            }
+        } else {
+            t.type = Token::PUNCT;
+            ++p;
+        }
+        t.len = p - t.text;
+        return t;
+    }
+};
+
+
+// named or positional argument of a call such as d1=5 or [1,2,3]
+struct Arg {
+    Token name; // empty if positional
+    vector<double> values; // one value unless it is a vector
+};
+
+struct Statement {
+    enum Kind {CALL, BLOCK, PREFIX, DEFINITION} kind;
+    // CALL is cube(...);   BLOCK is union(){...}   PREFIX is translate(...) followed by the object it applies to
+    // DEFINITION is module mod1(){...}
+    Token name;
+    vector<Arg> args;
+    vector<Statement> children; // BLOCK and DEFINITION
+};
+
+class Parser {
+    Tokenizer tokenizer;
+    Token cur;
+    void advance(){ cur = tokenizer.next(); }
+    bool fail(const string& msg){
+        if(error.empty()){
+            error = "line " + to_string(cur.line) + ": " + msg + " near '" + cur.str() + "'";
+        }
+        return false;
+    }
+    bool expect(char c){
+        if(!cur.is(c)){ return fail(string("expected '") + c + "'"); }
+        advance();
+        return true;
+    }
+    bool number(double& val){
+        bool negative = cur.is('-');
+        if(negative || cur.is('+')){ advance(); }
+        if(Token::IDENT == cur.type && (cur.is("inf") || cur.is("nan") || cur.is("true") || cur.is("false"))){
+            val = cur.is("inf") ? HUGE_VAL : cur.is("nan") ? NAN : cur.is("true") ? 1 : 0;
+        } else if(Token::NUMBER == cur.type && cur.len < 64){
+            char buff[64]; // strtod() needs a terminated string
+            memcpy(buff, cur.text, cur.len);
+            buff[cur.len] = 0;
+            char* e;
+            val = strtod(buff, &e);
+            if(e != buff + cur.len){ return fail("bad number"); }
+        } else {
+            return fail("expected a number");
+        }
+        if(negative){ val = -val; }
+        advance();
+        return true;
+    }
+    bool argument(Arg& arg){
+        if(Token::IDENT == cur.type && !cur.is("inf") && !cur.is("nan") && !cur.is("true") && !cur.is("false")){
+            arg.name = cur;
+            advance();
+            if(!expect('=')){ return false; }
+        }
+        if(!cur.is('[')){
+            arg.values.push_back(0);
+            return number(arg.values.back());
+        }
+        advance();
+        while(!cur.is(']')){
+            if(!arg.values.empty() && !expect(',')){ return false; }
+            arg.values.push_back(0);
+            if(!number(arg.values.back())){ return false; }
+        }
+        advance();
+        return true;
+    }
+    bool block(vector<Statement>& statements){ // statements until '}' or end of file
+        while(Token::END != cur.type && !cur.is('}')){
+            if(cur.is(';')){ // empty statement
+                advance();
+                continue;
+            }
+            statements.emplace_back();
+            if(!statement(statements.back())){ return false; }
+        }
+        return true;
+    }
+    bool statement(Statement& st){
+        if(Token::IDENT != cur.type){ return fail("expected a name"); }
+        if(cur.is("module")){
+            advance();
+            if(Token::IDENT != cur.type){ return fail("expected a module name"); }
+            st.kind = Statement::DEFINITION;
+            st.name = cur;
+            advance();
+            if( !expect('(') || !expect(')') || !expect('{') || !block(st.children) ){ return false; }
+            return expect('}');
+        }
+        st.name = cur;
+        advance();
+        if(!expect('(')){ return false; }
+        while(!cur.is(')')){
+            if(!st.args.empty() && !expect(',')){ return false; }
+            st.args.emplace_back();
+            if(!argument(st.args.back())){ return false; }
+        }
+        advance();
+        if(cur.is(';')){
+            st.kind = Statement::CALL;
+            advance();
+        } else if(cur.is('{')){
+            st.kind = Statement::BLOCK;
+            advance();
+            if(!block(st.children)){ return false; }
+            return expect('}');
+        } else {
+            st.kind = Statement::PREFIX;
+        }
+        return true;
+    }
+public:
+    string error;
+    Parser(const char* begin, const char* end): tokenizer(begin, end) { advance(); }
+    bool parse(vector<Statement>& statements){
+        return block(statements) && (Token::END == cur.type || fail("unexpected '}'"));
+    }
+};
+
+
+// makes editor objects from parsed statements
+class Builder {
+    unordered_map<int, shared_ptr<Operator>> modules; // by module id
+    bool fail(const Token& t, const string& msg){
+        if(error.empty()){ error = "line " + to_string(t.line) + ": " + msg + " '" + t.str() + "'"; }
+        return false;
+    }
+    static int moduleId(const Token& name){ // modules are named mod1, mod2... 0 if it is not a module name
+        if(name.len < 4 || 0 != strncmp(name.text, "mod", 3)){ return 0; }
+        int id = 0;
+        for(int i = 3; i < name.len; ++i){
+            if(!isdigit((unsigned char)name.text[i]) || id > 100000000){ return 0; }
+            id = id*10 + name.text[i]-'0';
+        }
+        return id;
+    }
+    // value of a named argument or of positional argument pos
+    static const Arg* arg(const Statement& st, const char* name, int pos){
+        for(size_t i = 0; i < st.args.size(); ++i){
+            if(st.args[i].name.len ? st.args[i].name.is(name) : (int)i == pos){ return &st.args[i]; }
+        }
+        return nullptr;
+    }
+    bool operatorType(const Statement& st, Operator::OperatorType& type){
+        if(Statement::BLOCK != st.kind || !st.args.empty()){ return fail(st.name, "expected union, difference or intersection instead of"); }
+        if(st.name.is("union")){ type = Operator::UNION; }
+        else if(st.name.is("difference")){ type = Operator::DIFFERENCE; }
+        else if(st.name.is("intersection")){ type = Operator::INTERSECTION; }
+        else { return fail(st.name, "unknown operator"); }
+        return true;
+    }
+    shared_ptr<Operator> makeOperator(const Statement& st){
+        Operator::OperatorType type;
+        if(!operatorType(st, type)){ return shared_ptr<Operator>(); }
+        return makeClone<Operator>(type);
+    }
+    shared_ptr<Object> makeXYZ(const Statement& st){
+        if(st.name.is("cube")){
+            const Arg* size = arg(st, "size", 0);
+            if(Statement::CALL != st.kind || !size || size->values.size() != 3){ fail(st.name, "expected cube([x,y,z])"); return nullptr; }
+            auto shape = makeClone<Shape>(Shape::CUBE);
+            shape->setValues(size->values[0], size->values[1], size->values[2]);
+            return shape;
+        }
+        if(st.name.is("cylinder")){
+            const Arg *h = arg(st, "h", 0), *d1 = arg(st, "d1", -1), *d2 = arg(st, "d2", -1);
+            if(Statement::CALL != st.kind || !h || !d1 || !d2){ fail(st.name, "expected cylinder(h=,d1=,d2=)"); return nullptr; }
+            auto shape = makeClone<Shape>(Shape::CYLINDER);
+            shape->setValues(h->values[0], d1->values[0], d2->values[0]);
+            return shape;
+        }
+        if(st.name.is("sphere")){
+            const Arg* d = arg(st, "d", -1);
+            if(Statement::CALL != st.kind || !d){ fail(st.name, "expected sphere(d=)"); return nullptr; }
+            auto shape = makeClone<Shape>(Shape::SPHERE);
+            shape->setValues(10, 10, d->values[0]);
+            return shape;
+        }
+        Modifier::ModifierType type;
+        if(st.name.is("translate")){ type = Modifier::TRANSLATE; }
+        else if(st.name.is("rotate")){ type = Modifier::ROTATE; }
+        else if(st.name.is("scale")){ type = Modifier::SCALE; }
+        else { fail(st.name, "unknown object"); return nullptr; }
+        const Arg* v = arg(st, "v", 0);
+        if(Statement::PREFIX != st.kind || !v || v->values.size() != 3){ fail(st.name, "expected [x,y,z] in"); return nullptr; }
+        auto modifier = makeClone<Modifier>(type);
+        modifier->setValues(v->values[0], v->values[1], v->values[2]);
+        return modifier;
+    }
+    // module definitions have to exist before they are called
+    bool declare(const vector<Statement>& statements){
+        for(auto& st: statements){
+            if(Statement::DEFINITION != st.kind){
+                if(!declare(st.children)){ return false; }
+                continue;
+            }
+            int id = moduleId(st.name);
+            if(!id){ return fail(st.name, "module names have to be mod1, mod2... not"); }
+            if(modules.count(id)){ return fail(st.name, "module defined twice"); }
+            if(st.children.size() != 1){ return fail(st.name, "module should contain one operator"); }
+            auto op = makeOperator(st.children[0]);
+            if(!op){ return false; }
+            op->setModuleId(id);
+            modules[id] = op;
+            definitions.push_back(op);
+            if(!declare(st.children[0].children)){ return false; }
+        }
+        return true;
+    }
+    bool fill(Operator& op, const vector<Statement>& statements){ // add children to an operator
+        for(auto& st: statements){
+            if(Statement::DEFINITION == st.kind){
+                auto child = modules[moduleId(st.name)];
+                op.addObject(child);
+                if(!fill(*child, st.children[0].children)){ return false; }
+            } else if(Statement::BLOCK == st.kind){
+                auto child = makeOperator(st);
+                if(!child){ return false; }
+                op.addObject(child);
+                if(!fill(*child, st.children)){ return false; }
+            } else if(Statement::CALL == st.kind && moduleId(st.name)){
+                auto it = modules.find(moduleId(st.name));
+                if(it == modules.end()){ return fail(st.name, "undefined module"); }
+                auto call = it->second->getModuleCall();
+                op.addObject(call);
+                calls.push_back( make_pair(call, it->second) );
+            } else {
+                auto child = makeXYZ(st);
+                if(!child){ return false; }
+                op.addObject(child);
+            }
+        }
+        return true;
+    }
+public:
+    string error;
+    vector<shared_ptr<Operator>> rows; // operators in Main
+    vector<shared_ptr<Operator>> definitions; // operators that have modules in the order they were defined
+    vector<pair<shared_ptr<Module>, shared_ptr<Operator>>> calls; // module calls need images of their modules
+    shared_ptr<Operator> view; // module called at the top level
+
+    bool build(const vector<Statement>& statements){
+        if(!declare(statements)){ return false; }
+        for(auto& st: statements){
+            if(Statement::DEFINITION == st.kind){
+                auto op = modules[moduleId(st.name)];
+                rows.push_back(op);
+                if(!fill(*op, st.children[0].children)){ return false; }
+            } else if(Statement::BLOCK == st.kind){
+                auto op = makeOperator(st);
+                if(!op){ return false; }
+                rows.push_back(op);
+                if(!fill(*op, st.children)){ return false; }
+            } else if(Statement::CALL == st.kind && moduleId(st.name)){
+                auto it = modules.find(moduleId(st.name));
+                if(it == modules.end()){ return fail(st.name, "undefined module"); }
+                view = it->second;
+            } else {
+                return fail(st.name, "only operators and modules can be at the top level, not");
+            }
+        }
+        return true;
+    }
+};
+
+
+bool ScadLoader::load(const string& fileName, shared_ptr<Main> const & main, shared_ptr<Labels> const & labels){
+    MappedFile file;
+    if(!file.open(fileName)){
+        LOG_ERROR("can not open " << fileName);
+        return false;
+    }
+    vector<Statement> statements;
+    Parser parser(file.begin, file.end);
+    if(!parser.parse(statements)){
+        LOG_ERROR(fileName << " " << parser.error);
+        return false;
+    }
+    Builder builder;
+    if(!builder.build(statements)){
+        LOG_ERROR(fileName << " " << builder.error);
+        return false;
+    }
+
+    for(auto& op: builder.rows){
+        main->addObject(op);
+    }
+    unordered_map<Operator*, shared_ptr<Module>> labelOf;
+    for(auto& op: builder.definitions){ // getModule() makes the image from the whole tree so it has to be done last
+        auto label = op->getModule();
+        labels->addObject(label);
+        labelOf[op.get()] = label;
+    }
+    for(auto& call: builder.calls){
+        call.first->setImage( labelOf[call.second.get()]->img );
+    }
+    if(builder.view){
+        ScadSaver::setView(builder.view);
+    }
+    LOG_INFO("Loaded " << builder.rows.size() << " operators and " << builder.definitions.size()
+             << " modules from " << fileName);
+    return true;
+}
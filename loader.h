@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <memory>
+
+struct Main;
+struct Labels;
+
+// Loads openscad code saved by asmcad back into the editor.
+// Only the subset of openscad generated by the saveScad() methods is understood:
+// module definitions, union/difference/intersection, translate/rotate/scale, cube/cylinder/sphere and module calls.
+// The file is memory mapped and tokenized in one pass without copying its text.
+class ScadLoader {
+public:
+    // adds operators found in fileName to main and their modules to labels.
+    // Nothing is added if the file has errors.  Returns false on error
+    static bool load(const std::string& fileName, std::shared_ptr<Main> const & main, std::shared_ptr<Labels> const & labels);
+};
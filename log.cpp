@@ -0,0 +1,118 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include "log.h"
+using namespace std;
+
+// Bounded multi-producer queue.  A slot can be written when its sequence equals the write position
+// and read when it equals the read position + 1.  See Dmitry Vyukov's bounded MPMC queue.
+static const size_t SLOTS = 1024; // power of 2
+static const size_t TEXT_SIZE = Log::MAX_MESSAGE;
+struct Slot {
+    atomic<size_t> sequence;
+    unsigned short size;
+    char text[TEXT_SIZE];
+};
+
+static Slot* makeRing(){
+    Slot* slots = new Slot[SLOTS]; // never deleted.  Static destructors may still log
+    for(size_t i = 0; i < SLOTS; ++i){ slots[i].sequence.store(i, memory_order_relaxed); }
+    return slots;
+}
+
+static Slot* ring = makeRing();
+static atomic<size_t> writePos(0);
+static size_t readPos = 0; // only the printing thread reads
+static atomic<unsigned long> droppedCount(0);
+static atomic<bool> running(false);
+static thread printer;
+
+int Log::level = Log::INFO; // debug messages only with -v 3.  Layout and hit-tests log a lot of them
+
+static bool push(const char* text, size_t size){
+    size_t pos = writePos.load(memory_order_relaxed);
+    for(;;){
+        Slot& s = ring[pos & (SLOTS-1)];
+        size_t seq = s.sequence.load(memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+        if(0 == diff && writePos.compare_exchange_weak(pos, pos+1, memory_order_relaxed)){ break; }
+        if(diff < 0){ return false; } // full
+        if(0 != diff){ pos = writePos.load(memory_order_relaxed); }
+    }
+    Slot& s = ring[pos & (SLOTS-1)];
+    s.size = min(size, TEXT_SIZE);
+    memcpy(s.text, text, s.size);
+    s.sequence.store(pos+1, memory_order_release);
+    return true;
+}
+
+static int drain(){ // prints all messages waiting in the ring.  Returns how many
+    int count = 0;
+    for(;;){
+        Slot& s = ring[readPos & (SLOTS-1)];
+        if(s.sequence.load(memory_order_acquire) != readPos+1){ break; }
+        cout.write(s.text, s.size) << '\n';
+        s.sequence.store(readPos + SLOTS, memory_order_release);
+        ++readPos;
+        ++count;
+    }
+    if(count){ cout.flush(); } // one flush per batch
+    return count;
+}
+
+static void print(){
+    while(running){
+        if(!drain()){ this_thread::sleep_for(chrono::milliseconds(10)); }
+    }
+    drain();
+}
+
+void Log::start(){
+    if(running){ return; }
+    running = true;
+    printer = thread(print);
+}
+
+void Log::stop(){
+    if(!running){ return; }
+    running = false;
+    printer.join();
+    unsigned long lost = droppedCount;
+    if(lost){ cout << "Log: " << lost << " messages were dropped" << endl; }
+}
+
+struct LogStream {
+    Log::Buffer buffer;
+    ostream out;
+    LogStream(): out(&buffer) {}
+};
+
+ostream& Log::stream(){
+    static thread_local LogStream s;
+    s.buffer.reset();
+    s.out.clear(); // a message that did not fit sets badbit
+    return s.out;
+}
+
+void Log::write(Level l, ostream& message){
+    auto buffer = static_cast<Log::Buffer*>(message.rdbuf());
+    if(!running){
+        cout.write(buffer->data(), buffer->size()) << endl;
+        return;
+    }
+    if(!push(buffer->data(), buffer->size())){ ++droppedCount; }
+}
+
+const char* Log::prefix(Level l){
+    switch(l){
+        case ERR:  return "ERROR: ";
+        case WARN: return "WARNING: ";
+        default:   return "";
+    }
+}
+
+unsigned long Log::dropped(){
+    return droppedCount;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <streambuf>
+
+// Leveled logging that does not make the UI thread wait for the terminal.
+// Messages are copied into a lock-free ring buffer and printed to stdout by a background thread.
+// If the buffer is full, messages are dropped and counted.  Before Log::start() they are printed right away.
+// LOG_DEBUG() is compiled out when NDEBUG is defined.  Log::setLevel() changes verbosity at runtime (INFO by default).
+// Errors and warnings are prefixed with "ERROR: " and "WARNING: " so messages should not repeat it.
+//     LOG_INFO("Loaded " << n << " objects");
+class Log {
+    static int level;
+public:
+    static const int MAX_MESSAGE = 240; // longer messages are cut
+    class Buffer: public std::streambuf { // formats a message without allocating memory
+        char text[MAX_MESSAGE];
+    public:
+        void reset(){ setp(text, text + MAX_MESSAGE); }
+        const char* data() const { return pbase(); }
+        size_t size() const { return pptr() - pbase(); }
+    };
+    static std::ostream& stream(); // empty stream for the next message.  One per thread
+    enum Level {ERR, WARN, INFO, DBG};
+    static void start(); // starts the thread printing messages
+    static void stop();  // prints waiting messages and stops the thread
+    static void setLevel(int leveL){ level = leveL; } // messages above this level are skipped
+    static bool enabled(Level l){ return l <= level; }
+    static void write(Level l, std::ostream& message); // message from stream().  Use LOG_*() macros instead
+    static const char* prefix(Level l); // written in front of the message
+    static unsigned long dropped(); // messages that did not fit into the buffer
+};
+
+#define LOG(lvl, msg) do { if(Log::enabled(lvl)){ std::ostream& logMessage = Log::stream(); logMessage << Log::prefix(lvl) << msg; Log::write(lvl, logMessage); } } while(0)
+#define LOG_ERROR(msg) LOG(Log::ERR, msg)
+#define LOG_WARN(msg)  LOG(Log::WARN, msg)
+#define LOG_INFO(msg)  LOG(Log::INFO, msg)
+#ifdef NDEBUG
+#define LOG_DEBUG(msg) do {} while(0)
+#else
+#define LOG_DEBUG(msg) LOG(Log::DBG, msg)
+#endif
@@ -3,85 +3,298 @@
 #include <memory>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <dirent.h>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "object.h"
+#include "preview.h"
+#include "scadwriter.h"
+#include "loader.h"
+#include "workspace.h"
+#include "log.h"
+#include "modgraph.h"
 using namespace std;
 
 
-// load an image as an SDL2 texture
+static unordered_map<string, weak_ptr<SDL_Texture>> images; // shared textures by file name
+static vector<shared_ptr<SDL_Texture>> preloaded; // keeps preloaded textures alive
+static unsigned long imageLoads = 0, imageHits = 0;
+
 shared_ptr<SDL_Texture> ImageLoader::getImage(const string& filename){
-    cout << "Loading " << filename << endl;
-    if(!renderer){
-        cout << "ERROR: SDL renderer was not set." << endl;
-        return nullptr;
+    auto texture = images[filename].lock();
+    if(texture){
+        ++imageHits;
+        return texture;
     }
+    texture = loadImage(filename);
+    images[filename] = texture;
+    return texture;
+}
+
+int ImageLoader::preload(const string& directory){
+    DIR* dir = opendir(directory.c_str());
+    if(!dir){ return 0; }
+    int count = 0;
+    while(dirent* entry = readdir(dir)){
+        string name = entry->d_name;
+        if(name.size() < 4 || name.compare(name.size()-4, 4, ".png") ){ continue; }
+        auto texture = getImage(directory + "/" + name);
+        if(!texture){ continue; }
+        preloaded.push_back(texture);
+        ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+void ImageLoader::report(ostream& out){
+    unsigned long long bytes = 0;
+    int textures = 0;
+    for(auto& i: images){
+        auto texture = i.second.lock();
+        int w = 0, h = 0;
+        if(!texture || SDL_QueryTexture(texture.get(), NULL, NULL, &w, &h)){ continue; }
+        bytes += 4ULL*w*h; // textures are uploaded as 32 bit pixels
+        ++textures;
+    }
+    out << "Images: " << imageLoads << " loads, " << imageHits << " hits, " << textures << " textures using " << bytes << " bytes" << endl;
+}
+
+// load an image as an SDL2 texture
+shared_ptr<SDL_Texture> ImageLoader::loadImage(const string& filename){
+    if(headless){ return nullptr; }
+    PROFILE("ImageLoader::loadImage");
+    LOG_DEBUG("Loading " << filename);
+    ++imageLoads;
     SDL_Surface* img = IMG_Load( filename.c_str() );
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, img);
+    auto texture = getImage(img);
     SDL_FreeSurface(img);
+    return texture;
+}
+
+shared_ptr<SDL_Texture> ImageLoader::getImage(SDL_Surface* surface){
+    if(!renderer){
+        if(!headless){ LOG_ERROR("SDL renderer was not set."); }
+        return nullptr;
+    }
+    if(!surface){ return nullptr; }
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+    if(!texture){ return nullptr; }
     return shared_ptr<SDL_Texture>(texture,&SDL_DestroyTexture);
 }
 
 SDL_Renderer* ImageLoader::renderer;
+bool ImageLoader::headless = false;
 
-std::shared_ptr<Object> ScadSaver::root;
 
-bool ScadSaver::makeObjectImage(shared_ptr<Object> const & obj){
-    const string TMP_FILE_SCAD = "tmp.scad";
-    const string TMP_FILE_IMG = "tmp.png";
+SDL_Rect Damage::screen = {0,0,0,0};
+SDL_Rect Damage::area = {0,0,0,0};
+bool Damage::dirty = false;
+unsigned long Damage::rendered = 0;
+unsigned long Damage::skipped = 0;
+
+void Damage::setScreen(int width, int height){
+    screen = {0, 0, width, height};
+    all();
+}
+
+void Damage::add(const SDL_Rect& rect){
+    SDL_Rect r;
+    if( !SDL_IntersectRect(&rect, &screen, &r) ){ return; } // off screen or empty
+    if(dirty){
+        SDL_UnionRect(&area, &r, &area);
+    } else {
+        area = r;
+        dirty = true;
+    }
+}
+
+SDL_Rect Damage::take(){
+    dirty = false;
+    return area;
+}
+
+bool MappedFile::open(const string& fileName){
+#ifdef _WIN32
+    ifstream file(fileName, ios::binary);
+    if(!file){ return false; }
+    contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    begin = contents.data();
+    end = begin + contents.size();
+    return true;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0){ return false; }
+    struct stat st;
+    bool ok = 0 == fstat(fd, &st);
+    size = ok ? st.st_size : 0;
+    if(ok && size > 0){
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = MAP_FAILED != map;
+        if(!ok){ map = nullptr; }
+    }
+    close(fd);
+    begin = map ? (const char*)map : contents.data();
+    end = begin + (map ? size : 0);
+    return ok;
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifndef _WIN32
+    if(map){ munmap(map, size); }
+#endif
+}
+
 
-    // save openscad code from a module/operator to a temp file
-    ofstream file(TMP_FILE_SCAD, ios_base::out | ios::trunc);
-    if(!root->saveScad(file)){
-        cout << "Error saving openscad code to temp file " << TMP_FILE_SCAD << endl;
+std::vector<std::shared_ptr<Previewer>> ScadSaver::previewers;
+std::weak_ptr<Operator> ScadSaver::view;
+unsigned long ScadSaver::viewVersion = 0;
+bool ScadSaver::split = false;
+
+static string moduleCall(shared_ptr<Operator> const & op){ // appended to the code to show op's module
+    stringstream call;
+    call << endl << op->getModuleName() << "();"<< endl;
+    return call.str();
+}
+
+// definitions of op's module and the modules it calls.  Other modules in Main are left out
+bool ScadSaver::moduleCode(shared_ptr<Operator> const & op, string& code){
+    ModuleGraph graph; // built every time since calls can change.  Walking it is cheap
+    stringstream s; // unchanged objects reuse their code.  See Object::writeScad()
+    if(!graph.saveScad(op, s)){
+        LOG_ERROR("can not generate openscad code.");
         return false;
     }
-    auto mod = static_pointer_cast<Module>(obj);
-    if(mod){
-        auto op = mod->getOperator();
-        file << endl << "mod" << op.get() << "();"<< endl;
+    code = s.str();
+    return true;
+}
+
+string ScadSaver::imageKey(shared_ptr<Operator> const & op){
+    // save openscad code from a module/operator.  It is the key of the image in ThumbnailCache
+    string code;
+    if(!moduleCode(op, code)){ return string(); }
+    return ThumbnailCache::key(ThumbnailCache::hash(code), code.size(), moduleCall(op));
+}
+
+bool ScadSaver::makeObjectImage(shared_ptr<Object> const & obj){
+    PROFILE("ScadSaver::makeObjectImage");
+    long long start = Profiler::now();
+    auto mod = dynamic_pointer_cast<Module>(obj);
+    auto op = mod ? mod->getOperator() : shared_ptr<Operator>();
+    if(!op){ return false; }
+    if(ImageLoader::isHeadless()){ return true; } // Batch renders modules by itself
+    string code;
+    if(!moduleCode(op, code)){ return false; }
+    string key = ThumbnailCache::key(ThumbnailCache::hash(code), code.size(), moduleCall(op));
+    auto texture = ThumbnailCache::get(key);
+    if(texture){ // this code was rendered before
+        PreviewQueue::cancel(obj);
+        obj->setImage(texture);
+        Profiler::imageMade(Profiler::now() - start);
+        return true;
+    }
+
+    // fast previewers set the image right away.  Slow ones set it when they are done
+    bool ok = false;
+    for(auto& p: previewers){
+        ok = p->preview(obj, op, code, moduleCall(op), key) || ok;
     }
-    file.close();
-
-    // run openscad to produce TMP_FILE_IMG from TMP_FILE_SCAD
-    string cmd = "openscad --viewall --autocenter -o "+TMP_FILE_IMG+" "+TMP_FILE_SCAD;
-    cout << endl << "Running " << cmd << endl;
-    int result = system(cmd.c_str());
-    cout << "openscad returned errlevel " << result << endl << endl;
-
-    // load the image generated by openscad and set it for the object
-    auto texture = ImageLoader::getImage(TMP_FILE_IMG);
-    if(!texture){ return false; }
-    obj->setImage(texture);
+    if(!obj->img){ obj->setImage( PreviewQueue::placeholder() ); }
+    Profiler::imageMade(Profiler::now() - start);
+    return ok;
+}
+
+void ScadSaver::setView(shared_ptr<Operator> const & op){
+    view = op;
+    viewVersion = 0; // save it even if code did not change
+    saveView();
+}
+
+static string moduleFile(const string& mainFile, int moduleId){ // asm.scad -> asm_mod3.scad
+    string base = mainFile;
+    const string EXT = ".scad";
+    if(base.size() > EXT.size() && 0 == base.compare(base.size()-EXT.size(), EXT.size(), EXT)){ base.resize(base.size()-EXT.size()); }
+    return base + "_mod" + to_string(moduleId) + EXT;
+}
+
+static string useLine(const string& file){ // files are in the same directory
+    return "use <" + file.substr(file.find_last_of("/\\") + 1) + ">\n";
+}
+
+// one file per module in the order they are needed followed by the main file
+static bool splitFiles(shared_ptr<Operator> const & op, vector<ScadWriter::File>& files){
+    ModuleGraph g;
+    vector<shared_ptr<Operator>> modules;
+    if(!g.sort(op, modules)){ return false; }
+    string mainFile = ScadWriter::fileName();
+    for(auto& m: modules){
+        stringstream code;
+        for(int id: g.calls(m->getModuleId())){ code << useLine(moduleFile(mainFile, id)); } // use is not transitive
+        if(!m->writeScad(code)){
+            LOG_ERROR("can not generate openscad code.");
+            return false;
+        }
+        files.push_back({moduleFile(mainFile, m->getModuleId()), code.str()});
+    }
+    files.push_back({mainFile, useLine(moduleFile(mainFile, op->getModuleId())) + moduleCall(op)});
     return true;
 }
 
+void ScadSaver::saveView(){
+    auto op = view.lock();
+    if(!op || !op->getModuleId() || viewVersion == Object::scadVersion){ return; } // module can be undone
+    PROFILE("ScadSaver::saveView");
+    viewVersion = Object::scadVersion;
+    if(split){
+        vector<ScadWriter::File> files;
+        if(splitFiles(op, files)){ ScadWriter::post(move(files)); }
+        return;
+    }
+    string code;
+    if(!moduleCode(op, code)){ return; }
+    ScadWriter::post(code + moduleCall(op));
+}
+
 
 // returns a root object that gets rendered and renders all of its children
-std::shared_ptr<Object> initGui(int width, int height){
+std::shared_ptr<Object> initGui(int width, int height, const string& loadFile){
+    PROFILE("initGui");
     srand (time(NULL));
-    auto root   = make_shared<VerticalLayout>(width, height, true);
-    auto menu   = make_shared<FlowLayout>(width,true); // top menu
-    auto level2 = make_shared<FlowLayout>(width,true); // container for labels and main
-    auto labels = make_shared<Labels>(ITEM_WIDTH, height-ITEM_HEIGHT); // module pics
-    auto main   = make_shared<Main>(width-ITEM_WIDTH, height-ITEM_HEIGHT); // main "code" area
-
-    ScadSaver::setRoot(main); // main is the component that contains ALL scad code that needs to be saved
-    auto dzView       = make_shared<DropZone>(DropZone::VIEW, main);
-    auto union_       = make_shared<Operator>(Operator::UNION);
-    auto difference   = make_shared<Operator>(Operator::DIFFERENCE);
-    auto intersection = make_shared<Operator>(Operator::INTERSECTION);
-    auto cube         = make_shared<Shape>(Shape::CUBE);
-    auto cylinder     = make_shared<Shape>(Shape::CYLINDER);
-    auto sphere       = make_shared<Shape>(Shape::SPHERE);
-    auto translate    = make_shared<Modifier>(Modifier::TRANSLATE);
-    auto rotate       = make_shared<Modifier>(Modifier::ROTATE);
-    auto scale        = make_shared<Modifier>(Modifier::SCALE);
-    auto custom       = make_shared<Custom>();
-    auto dzDelete     = make_shared<DropZone>(DropZone::DELETE, main);
+    auto root   = makeObject<VerticalLayout>(width, height, true);
+    auto menu   = makeObject<FlowLayout>(width,true); // top menu
+    auto level2 = makeObject<FlowLayout>(width,true); // container for labels and main
+    auto labels = makeObject<Labels>(ITEM_WIDTH, height-ITEM_HEIGHT); // module pics
+    auto main   = makeObject<Main>(width-ITEM_WIDTH, height-ITEM_HEIGHT); // main "code" area
+
+    auto dzView       = makeObject<DropZone>(DropZone::VIEW, main);
+    auto union_       = makeObject<Operator>(Operator::UNION);
+    auto difference   = makeObject<Operator>(Operator::DIFFERENCE);
+    auto intersection = makeObject<Operator>(Operator::INTERSECTION);
+    auto cube         = makeObject<Shape>(Shape::CUBE);
+    auto cylinder     = makeObject<Shape>(Shape::CYLINDER);
+    auto sphere       = makeObject<Shape>(Shape::SPHERE);
+    auto translate    = makeObject<Modifier>(Modifier::TRANSLATE);
+    auto rotate       = makeObject<Modifier>(Modifier::ROTATE);
+    auto scale        = makeObject<Modifier>(Modifier::SCALE);
+    auto custom       = makeObject<Custom>();
+    auto dzDelete     = makeObject<DropZone>(DropZone::DELETE, main);
 
     root  ->addObject(menu);
     root  ->addObject(level2);
     level2->addObject(labels);
     level2->addObject(main);
+    menu->setRetained(true); // changes only when the window is resized
+    labels->setRetained(true);
 
     menu->addObject(dzView);
     menu->addObject(union_);
@@ -96,6 +309,13 @@ std::shared_ptr<Object> initGui(int width, int height){
     menu->addObject(custom);
     menu->addObject(dzDelete);
 
+    Workspace::setLayouts(main, labels);
+    const string EXT = ".asmcad";
+    if(loadFile.size() > EXT.size() && 0 == loadFile.compare(loadFile.size()-EXT.size(), EXT.size(), EXT)){
+        Workspace::load(loadFile);
+    } else if(!loadFile.empty()){
+        ScadLoader::load(loadFile, main, labels);
+    }
     root->setLocation(Point(0,0)); // perform layout
     return root;
 }
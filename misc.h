@@ -2,28 +2,85 @@
 #include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
 #include <string>
 #include <memory>
+#include <vector>
 
 class Object;
-std::shared_ptr<Object> initGui(int width, int height); // initialize layout of the application's GUI
+std::shared_ptr<Object> initGui(int width, int height, const std::string& loadFile = ""); // initialize layout of the application's GUI
 
 
 // load SDL texture from a png image
-// this class has to be initialized by calling ImageLoader::setRenderer()
+// Textures returned by getImage() are shared by all objects using the same file.
+// A file is loaded again only after all objects using its texture are gone (unless it was preloaded).
+// this class has to be initialized by calling ImageLoader::setRenderer() or ImageLoader::setHeadless()
 class ImageLoader {
     static SDL_Renderer* renderer;
+    static bool headless;
 public:
     static void setRenderer(SDL_Renderer* rendereR){ renderer = rendereR; }
-    static std::shared_ptr<SDL_Texture> getImage(const std::string& filename);
+    static void setHeadless(){ headless = true; } // no renderer on purpose (see Batch).  Images are not loaded and null is returned
+    static bool isHeadless(){ return headless; }
+    static std::shared_ptr<SDL_Texture> getImage(const std::string& filename); // shared texture
+    static std::shared_ptr<SDL_Texture> loadImage(const std::string& filename); // not shared.  Use for files that change
+    static std::shared_ptr<SDL_Texture> getImage(SDL_Surface* surface); // does not free the surface
+    static int preload(const std::string& directory); // keep all png images from a directory in memory
+    static void report(std::ostream& out); // print number of loads, hits and texture memory
 };
 
 
-// save openscad code to a file and make an image from it
-// this class has to be initialized by calling ScadSaver::setRoot()
+class Previewer;
+class Operator;
+
+// read-only view of a whole file.  Memory mapped where possible
+class MappedFile {
+    void* map = nullptr;
+    size_t size = 0;
+    std::string contents; // used where mmap() is not available
+public:
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    bool open(const std::string& fileName); // returns false on error
+    ~MappedFile();
+};
+
+
+// save openscad code and make an image from it using previewers (see preview.h)
+// Only the modules the shown module needs are saved.  See ModuleGraph
+// this class has to be initialized by calling ScadSaver::addPreviewer()
 class ScadSaver {
-    static std::shared_ptr<Object> root;
+    static std::vector<std::shared_ptr<Previewer>> previewers;
+    static std::weak_ptr<Operator> view; // module shown in openscad
+    static unsigned long viewVersion; // Object::scadVersion when view was saved last time
+    static bool split; // view is saved as one file per module
 public:
-    static void setRoot(std::shared_ptr<Object> const & rooT){ root = rooT; }
+    static bool moduleCode(std::shared_ptr<Operator> const & op, std::string& code); // modules op needs.  Returns false on error
+    static void addPreviewer(std::shared_ptr<Previewer> const & previewer){ previewers.push_back(previewer); }
     static bool makeObjectImage(std::shared_ptr<Object> const & obj);
+    static std::string imageKey(std::shared_ptr<Operator> const & op); // ThumbnailCache key of op's module image.  Empty on error
+    static void setView(std::shared_ptr<Operator> const & op); // save code calling op's module every time code changes
+    static void saveView(); // call once per frame.  Posts code to ScadWriter if it changed
+    // Save every module of the view into its own file (asm_mod1.scad...) that the main file uses.
+    // Only files that changed are written so openscad reloads only them
+    static void setSplit(bool on){ split = on; viewVersion = 0; }
+};
+
+
+// Keeps track of the area of the screen that has to be redrawn
+// Objects call Damage::add() when their state, layout or image changes
+class Damage {
+    static SDL_Rect screen; // damaged area is clipped to screen
+    static SDL_Rect area;   // bounding box of all damaged rectangles
+    static bool dirty;
+    static unsigned long rendered, skipped; // frame counters
+public:
+    static void setScreen(int width, int height);
+    static void add(const SDL_Rect& rect);
+    static void all(){ add(screen); } // redraw the whole screen
+    static bool isDirty(){ return dirty; }
+    static SDL_Rect take(); // returns damaged area and clears it
+    static void frameRendered(){ ++rendered; }
+    static void frameSkipped(){ ++skipped; }
+    static unsigned long framesRendered(){ return rendered; }
+    static unsigned long framesSkipped(){ return skipped; }
 };
 
 
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "modgraph.h"
+#include "object.h"
+#include "log.h"
+using namespace std;
+
+void ModuleGraph::collectCalls(Object* obj, vector<int>& calls){
+    const vector<shared_ptr<Object>>* children = nullptr;
+    if(auto op = dynamic_cast<Operator*>(obj)){
+        children = &op->getChildren();
+    } else if(auto layout = dynamic_cast<FlowLayout*>(obj)){
+        children = &layout->getChildren();
+    } else {
+        return; // shapes and modifiers do not call modules
+    }
+    for(auto& child: *children){
+        auto mod = dynamic_cast<Module*>(child.get());
+        auto op = dynamic_cast<Operator*>(child.get());
+        int id = 0;
+        if(mod){ // module call
+            id = add(mod->getOperator());
+        } else if(op && op->getModuleId()){ // module defined inside another one.  It is also saved on its own
+            id = add(static_pointer_cast<Operator>(child));
+        } else {
+            collectCalls(child.get(), calls);
+        }
+        if(id && find(calls.begin(), calls.end(), id) == calls.end()){ calls.push_back(id); }
+    }
+}
+
+int ModuleGraph::add(shared_ptr<Operator> const & op){
+    int id = op ? op->getModuleId() : 0;
+    if(!id || nodes.count(id)){ return id; }
+    nodes[id].op = op; // added before its calls so that loops end here
+    vector<int> calls;
+    collectCalls(op.get(), calls);
+    nodes[id].calls = calls;
+    return id;
+}
+
+// depth first search.  Modules are added to out after the modules they call
+bool ModuleGraph::visit(int id, vector<shared_ptr<Operator>>& out, vector<int>& path){
+    Node& node = nodes[id];
+    node.mark = 1; // on path
+    path.push_back(id);
+    for(int callee: node.calls){
+        int mark = nodes[callee].mark;
+        if(1 == mark){ // loop from callee back to itself
+            cycle.assign(find(path.begin(), path.end(), callee), path.end());
+            cycle.push_back(callee);
+            return false;
+        }
+        if(0 == mark && !visit(callee, out, path)){ return false; }
+    }
+    node.mark = 2; // done
+    path.pop_back();
+    out.push_back(node.op);
+    return true;
+}
+
+bool ModuleGraph::sort(shared_ptr<Operator> const & op, vector<shared_ptr<Operator>>& out){
+    out.clear();
+    cycle.clear();
+    int id = add(op);
+    if(!id){ return false; }
+    for(auto& n: nodes){ n.second.mark = 0; }
+    vector<int> path;
+    if(visit(id, out, path)){ return true; }
+    LOG_ERROR("modules call each other in a loop: " << cycleText(cycle));
+    return false;
+}
+
+bool ModuleGraph::saveScad(shared_ptr<Operator> const & op, ostream& file){
+    vector<shared_ptr<Operator>> modules;
+    if(!sort(op, modules)){ return false; }
+    bool ok = true;
+    for(auto& m: modules){
+        ok = m->writeScad(file) && ok;
+    }
+    return ok;
+}
+
+string ModuleGraph::cycleText(const vector<int>& cycle){
+    stringstream text;
+    for(size_t i = 0; i < cycle.size(); ++i){
+        text << (i ? " -> " : "") << "mod" << cycle[i];
+    }
+    return text.str();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Object;
+class Operator;
+
+// Which modules call which.  A module calls another one if a clone of the other Module was
+// placed anywhere inside its Operator's layout.  Used to save only the modules a module needs
+// instead of all the code in Main.  Nodes are added on demand and keyed by module id.
+class ModuleGraph {
+    struct Node {
+        std::shared_ptr<Operator> op;
+        std::vector<int> calls; // ids of modules called directly
+        int mark = 0; // used by sort()
+    };
+    std::unordered_map<int, Node> nodes;
+    void collectCalls(Object* obj, std::vector<int>& calls); // walks obj's children
+    bool visit(int id, std::vector<std::shared_ptr<Operator>>& out, std::vector<int>& path);
+public:
+    std::vector<int> cycle; // module ids of the cycle found by the last sort().  First id is repeated at the end
+    void clear(){ nodes.clear(); }
+    int add(std::shared_ptr<Operator> const & op); // op and the modules it calls.  Returns op's module id or 0 if it is not a module
+    // op's module and all modules it calls directly or indirectly.  Called modules come first.
+    // Returns false and logs an error if the modules call each other in a loop.  See cycle
+    bool sort(std::shared_ptr<Operator> const & op, std::vector<std::shared_ptr<Operator>>& out);
+    // definitions of op's module and the modules it needs.  Returns false on error
+    bool saveScad(std::shared_ptr<Operator> const & op, std::ostream& file);
+    const std::vector<int>& calls(int id){ return nodes[id].calls; } // modules called directly by module id
+    size_t size() const { return nodes.size(); }
+    static std::string cycleText(const std::vector<int>& cycle); // "mod1 -> mod2 -> mod1"
+};
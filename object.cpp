@@ -1,11 +1,14 @@
 #include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
 #include <algorithm>
 #include <iostream>
-#include <fstream>
+#include <sstream>
 #include "misc.h"
 #include "object.h"
+#include "csg.h"
+#include "log.h"
+#include "render.h"
+#include "history.h"
 using namespace std;
-const string OUTPUT_FILE_SCAD = "asm.scad";
 
 
 Object::Object() {
@@ -15,19 +18,63 @@ Object::Object() {
     loc.h = ITEM_HEIGHT;
 }
 
+void Object::layoutChanged(){ // if an object is dirty, its containers are already dirty
+    for(Object* o = this; o && !(o->sizeDirty && o->layoutDirty); o = o->container){
+        o->sizeDirty = o->layoutDirty = true;
+    }
+}
+
 void Object::setLocation(const Point& xy){
+    layoutDirty = false;
+    if(loc.x == xy.x && loc.y == xy.y){ return; }
+    Damage::add(loc); // old location.  Moving does not change how the object looks
     loc.x = xy.x;
     loc.y = xy.y;
+    Damage::add(loc); // new location
+    geometryChanged();
 }
 
-void Object::draw(SDL_Renderer* rend){
-    SDL_RenderCopy(rend, img.get(), NULL, &loc);
-    if(draggedOver){
-        SDL_SetRenderDrawColor(rend, 255, 0, 0, SDL_ALPHA_OPAQUE);
-    } else {
-        SDL_SetRenderDrawColor(rend, 255, 255, 255, SDL_ALPHA_OPAQUE);
+std::shared_ptr<Object> Object::self(){
+    if(!embedded || !container){ return shared_from_this(); }
+    return std::shared_ptr<Object>(container->self(), this);
+}
+
+void Object::contentChanged(){
+    for(Object* o = this; o; o = o->container){
+        if(o->retained){ o->retained->stale = true; }
+    }
+}
+
+void Object::setRetained(bool on){
+    if(on && !retained){ retained.reset(new RetainedImage()); }
+    if(!on){ retained.reset(); }
+    invalidate();
+}
+
+bool Object::writeScad(ostream& file){
+    if(scadDirty){
+        stringstream code;
+        scadOk = saveScad(code);
+        scadCode = code.str();
+        scadDirty = false;
     }
-    SDL_RenderDrawRect(rend, &loc);
+    file << scadCode;
+    return scadOk;
+}
+
+unsigned long Object::scadVersion = 1;
+
+void Object::scadChanged(){
+    if(scadDirty){ return; } // if an object is dirty, its containers are already dirty
+    ++scadVersion;
+    for(Object* o = this; o && !o->scadDirty; o = o->container){
+        o->scadDirty = true;
+    }
+}
+
+void Object::draw(SDL_Renderer* rend){
+    RenderBatch::image(img.get(), loc);
+    RenderBatch::outline(loc, draggedOver);
 }
 
 
@@ -36,21 +83,51 @@ bool Module::saveScad(ostream& file){
     auto sp = parent.lock();
     if(!sp){ return false; }
     if(isClone){ // clones call the module.  Non-clones save the code. TODO: will this work???
-        file << "mod" << sp.get() << "();";
+        file << static_pointer_cast<Operator>(sp)->getModuleName() << "();";
         return true;
     }
     return sp->saveScad(file);
 }
 
+void Module::saveCsg(CsgBuilder& csg){
+    const int MAX_DEPTH = 64; // modules calling each other in a loop
+    auto op = getOperator();
+    if(!op || !isClone || csg.depth >= MAX_DEPTH){ return; }
+    ++csg.depth;
+    op->saveModuleCsg(csg);
+    --csg.depth;
+}
+
 std::shared_ptr<Object> Module::clone(){
     auto sp = parent.lock();
     if(!sp){ return shared_ptr<Object>(); }
-    auto obj = std::make_shared<Module>(sp);
+    auto obj = makeClone<Module>(sp);
     obj->img = img;
-    obj->isClone = true;
+    static_pointer_cast<Operator>(sp)->showModuleIn(obj); // images rendered in the background reach the copy too
     return obj;
 }
 
+void Module::setImage(std::shared_ptr<SDL_Texture> sdlTexture){
+    Object::setImage(sdlTexture);
+    auto sp = parent.lock();
+    if(sp){ sp->invalidate(); } // Operator draws its module's image
+    for(auto& w: shownIn){
+        auto obj = w.lock();
+        if(obj){ obj->setImage(sdlTexture); }
+    }
+}
+
+void Module::showIn(shared_ptr<Object> const & obj){
+    shownIn.erase( remove_if(begin(shownIn), end(shownIn), [](weak_ptr<Object>& w){ return w.expired(); }), end(shownIn) );
+    if(obj.get() == this){ return; }
+    shownIn.push_back(obj);
+    obj->setImage(img);
+}
+
+void Module::hideIn(Object* obj){
+    shownIn.erase( remove_if(begin(shownIn), end(shownIn), [&](weak_ptr<Object>& w){ return w.expired() || w.lock().get() == obj; }), end(shownIn) );
+}
+
 shared_ptr<Operator> Module::getOperator(){
     return dynamic_pointer_cast<Operator>( parent.lock() );
 }
@@ -65,29 +142,46 @@ std::shared_ptr<Text> Input::printer;
 
 void Input::draw(SDL_Renderer* rend){
     if(!enabled){ return; }
-    SDL_SetRenderDrawColor(rend, 0, 0, 0, SDL_ALPHA_OPAQUE);
-    SDL_RenderFillRect(rend, &loc);
-    char buff[64];
-    sprintf(buff,"%.2f", value);
-    static SDL_Color color = { 255, 255, 0, SDL_ALPHA_OPAQUE };
-    printer->print(string(buff), loc.x, loc.y, rend, color); // TODO: fix that string conversion
+    static const SDL_Color BACKGROUND = { 0, 0, 0, SDL_ALPHA_OPAQUE };
+    RenderBatch::fill(loc, BACKGROUND);
+    if(!valueImg || valueImgValue != value){
+        char buff[64];
+        snprintf(buff, sizeof(buff), "%.2f", value);
+        static SDL_Color color = { 255, 255, 0, SDL_ALPHA_OPAQUE };
+        if(!printer){ printer = make_shared<Text>(16); }
+        valueImg = printer->render(buff, rend, valueImgLoc.w, valueImgLoc.h, color);
+        valueImgValue = value;
+    }
+    valueImgLoc.x = loc.x;
+    valueImgLoc.y = loc.y;
+    RenderBatch::image(valueImg.get(), valueImgLoc, RenderBatch::TEXT);
+}
+
+void Input::setValue(double val){
+    if(val == value){ return; }
+    History::valueChanged(*this, value, val);
+    value = val;
+    invalidate();
+    if(container){ container->scadChanged(); } // code of Inputs is saved by their XYZ
+    else { scadChanged(); }
 }
 
 std::shared_ptr<Object> Input::click(const Point& xy){
     if( !xy.inRectangle(loc) ){ return shared_ptr<Object>(); }
-    std::cout << '<' << endl;
+    LOG_DEBUG("Input selected");
     delta = 1.0;
-    return shared_from_this();
+    return self();
 }
 
 std::shared_ptr<Object> Input::clickr(const Point& xy){ // change it slowly after right click
     if( !xy.inRectangle(loc) ){ return shared_ptr<Object>(); }
-    std::cout << '>' << endl;
+    LOG_DEBUG("Input selected for fine changes");
     delta = 0.01;
-    return shared_from_this();
+    return self();
 }
 
 
+
 Modifier::Modifier(ModifierType mt): type(mt) {
     string fName;
     switch(type){
@@ -105,33 +199,39 @@ bool Modifier::saveScad(ostream& file){
         case SCALE:     file << "scale";     break;
     }
     file << "([";
-    x->saveScad(file);
+    x.saveScad(file);
     file << ",";
-    y->saveScad(file);
+    y.saveScad(file);
     file << ",";
-    z->saveScad(file);
+    z.saveScad(file);
     file << "]) ";
     return true;
 }
 
+void Modifier::saveCsg(CsgBuilder& csg){
+    switch(type){
+        case ROTATE:    csg.rotate(x.getValue(), y.getValue(), z.getValue());    break;
+        case TRANSLATE: csg.translate(x.getValue(), y.getValue(), z.getValue()); break;
+        case SCALE:     csg.scale(x.getValue(), y.getValue(), z.getValue());     break;
+    }
+}
+
 std::shared_ptr<Object> Modifier::clone(){
-    auto obj = std::make_shared<Modifier>(type);
-    obj->isClone = true;
-    return obj;
+    return makeClone<Modifier>(type);
 }
 
 
 Shape::Shape(ShapeType st): type(st) {
-    x->setValue(10.0);
-    y->setValue(10.0);
-    z->setValue(10.0);
+    x.setValue(10.0);
+    y.setValue(10.0);
+    z.setValue(10.0);
     string imgFileName;
     switch(type){
         case CUBE: imgFileName = "img/cube.png"; break;
         case CYLINDER: imgFileName = "img/cylinder.png"; break;
         case SPHERE: imgFileName = "img/sphere.png"; 
-            x->disable(); // sphere has only one variable
-            y->disable();
+            x.disable(); // sphere has only one variable
+            y.disable();
             break;
     }
     img = ImageLoader::getImage(imgFileName); 
@@ -140,23 +240,23 @@ Shape::Shape(ShapeType st): type(st) {
 bool Shape::saveScad(ostream& file){
     switch(type){
         case CUBE: file << "cube([";
-            x->saveScad(file);
+            x.saveScad(file);
             file << ",";
-            y->saveScad(file);
+            y.saveScad(file);
             file << ",";
-            z->saveScad(file);
+            z.saveScad(file);
             file << "],center=true);" << endl; 
             break;
         case CYLINDER: file << "cylinder(h=";
-            x->saveScad(file);
+            x.saveScad(file);
             file << ",d1=";
-            y->saveScad(file);
+            y.saveScad(file);
             file << ",d2=";
-            z->saveScad(file);
+            z.saveScad(file);
             file << ",center=true);" << endl;
             break;
         case SPHERE: file << "sphere(d=";
-            z->saveScad(file);
+            z.saveScad(file);
             file << ");" << endl;
             break;
         default: break;
@@ -164,49 +264,68 @@ bool Shape::saveScad(ostream& file){
     return true;
 }
 
+void Shape::saveCsg(CsgBuilder& csg){
+    shared_ptr<CsgNode> node;
+    switch(type){
+        case CUBE:     node = make_shared<CsgNode>(CsgNode::CUBE);     break;
+        case CYLINDER: node = make_shared<CsgNode>(CsgNode::CYLINDER); break;
+        case SPHERE:   node = make_shared<CsgNode>(CsgNode::SPHERE);
+            node->size[0] = z.getValue(); // same as saveScad()
+            csg.add(node);
+            return;
+    }
+    node->size[0] = x.getValue();
+    node->size[1] = y.getValue();
+    node->size[2] = z.getValue();
+    csg.add(node);
+}
+
 std::shared_ptr<Object> Shape::clone(){
-    auto obj = std::make_shared<Shape>(type);
-    obj->isClone = true;
-    return obj;
+    return makeClone<Shape>(type);
 }
 
 
 XYZ::XYZ(){
-    x = make_shared<Input>();
-    y = make_shared<Input>();
-    z = make_shared<Input>();
+    x.container = y.container = z.container = this;
+    x.embedded = y.embedded = z.embedded = true;
 }
 
 void XYZ::draw(SDL_Renderer* rend){
     Object::draw(rend);
-    x->draw(rend);
-    y->draw(rend);
-    z->draw(rend);
+    x.draw(rend);
+    y.draw(rend);
+    z.draw(rend);
 }
 
 void XYZ::setLocation(const Point& xy){
     Object::setLocation(xy);
-    x->setLocation(Point(xy.x+10,xy.y+90));
-    y->setLocation(Point(xy.x+10,xy.y+110));
-    z->setLocation(Point(xy.x+10,xy.y+130));
+    x.setLocation(Point(xy.x+10,xy.y+90));
+    y.setLocation(Point(xy.x+10,xy.y+110));
+    z.setLocation(Point(xy.x+10,xy.y+130));
+}
+
+void XYZ::setValues(double X, double Y, double Z){
+    x.setValue(X);
+    y.setValue(Y);
+    z.setValue(Z);
 }
 
 std::shared_ptr<Object> XYZ::click(const Point& xy){
-    auto o = x->click(xy);
+    auto o = x.click(xy);
     if(o){ return o; }
-    o = y->click(xy);
+    o = y.click(xy);
     if(o){ return o; }
-    o = z->click(xy);
+    o = z.click(xy);
     if(o){ return o; }
     return shared_ptr<Object>();
 }
 
 std::shared_ptr<Object> XYZ::clickr(const Point& xy){
-    auto o = x->clickr(xy);
+    auto o = x.clickr(xy);
     if(o){ return o; }
-    o = y->clickr(xy);
+    o = y.clickr(xy);
     if(o){ return o; }
-    o = z->clickr(xy);
+    o = z.clickr(xy);
     if(o){ return o; }
     return shared_ptr<Object>();
 }
@@ -221,13 +340,16 @@ bool DropZone::dropped(const Point& xy, std::shared_ptr<Object>const & obj){
         } else {
             op = mod->getOperator();
         }
-        if(mod){
-            img = mod->img;
+        auto last = viewed.lock();
+        if(last){ last->hideModuleIn(this); }
+        viewed = op;
+        if(op && op->getModuleId()){
+            op->showModuleIn(shared_from_this()); // the image may still be rendering
+        } else if(mod){
+            setImage(mod->img);
         }
         if(op){
-            ofstream file(OUTPUT_FILE_SCAD, ios_base::out | ios::trunc);
-            root->saveScad(file);
-            file << endl << "mod" << op.get() << "();" << endl;
+            ScadSaver::setView(op); // ScadWriter saves it in the background
         }
     } else {
         // TODO: remove the object from main view, module view and DropZoneView
@@ -5,24 +5,49 @@
 #include <memory>
 #include "misc.h"
 #include "sdltext.h"
+#include "spatial.h"
+#include "pool.h"
+#include "profile.h"
+#include "render.h"
 
 #define ITEM_HEIGHT 150
 #define ITEM_WIDTH 100
 
+class CsgBuilder;
+
 struct Object: public std::enable_shared_from_this<Object>{
     bool isClone = false;
     bool draggedOver = false;
     SDL_Rect loc; // location and dimentions of the Object
     std::shared_ptr<SDL_Texture> img; // Object's background image
+    Object* container = nullptr; // object this one was added to.  Changes are propagated to it
+    bool embedded = false; // member of its container instead of being allocated on its own
     Object();
 
     // The way children are removed is by dragging them out but sometimes they also have to be deleted from other objects
     virtual bool removeChild(std::shared_ptr<Object>& obj){ return false; };
     virtual bool saveScad(std::ostream& file)=0; // save self and children into an openscad file
+    bool writeScad(std::ostream& file); // same as saveScad() but reuses the code saved last time if nothing changed
+    void scadChanged(); // code of this object and all its containers has to be regenerated
+    static unsigned long scadVersion; // incremented every time code of any object changes after it was saved
+    virtual void saveCsg(CsgBuilder& csg){} // add own geometry to csg the way openscad would build it from saveScad()
+    // Layout is done in two passes.  measure() sets loc.w and loc.h to the size the object needs.
+    // setLocation() places the object and its children.  Both do nothing if nothing changed since last time.
+    virtual void measure(){ sizeDirty = false; }
     virtual void setLocation(const Point& xy);
-    virtual void setImage(std::shared_ptr<SDL_Texture> sdlTexture){ img = sdlTexture; }
+    void layoutChanged(); // call when size or children change.  This object and its containers will be laid out again
+    bool sizeDirty = true;   // measure() has to run again
+    bool layoutDirty = true; // setLocation() has to place children even if location did not change
+    virtual void setImage(std::shared_ptr<SDL_Texture> sdlTexture){ img = sdlTexture; invalidate(); }
     virtual void draw(SDL_Renderer* rend);
+    void invalidate(){ Damage::add(loc); contentChanged(); } // schedule this object to be redrawn
+    void contentChanged(); // retained images of this object and its containers have to be drawn again
+    void setRetained(bool on); // keep an image of this object and its children.  See RetainedImage
+    bool drawRetained(SDL_Renderer* rend){ return retained && retained->draw(rend, *this); } // false if draw() has to draw
+    void geometryChanged(){ if(container){ container->childGeometryChanged(); } } // call after loc changes
+    virtual void childGeometryChanged(){}
     virtual std::shared_ptr<Object> clone(){ return shared_from_this(); }; // by default just return self
+    std::shared_ptr<Object> self(); // shared_from_this() that also works for embedded objects.  It shares ownership of the container
 
     virtual std::shared_ptr<Object> click (const Point& xy){ return std::shared_ptr<Object>(); } // mouse click
     virtual std::shared_ptr<Object> clickr(const Point& xy){ return std::shared_ptr<Object>(); } // right click
@@ -33,42 +58,80 @@ struct Object: public std::enable_shared_from_this<Object>{
          return isClone ? shared_from_this() : clone(); // our system has a bizzare property where Objects can be cloned only once
     }
     // another object is dragged accross this one
-    virtual void drag(const Point& xy){ draggedOver = true; }
-    virtual void dragEnd(){ draggedOver = false; }
+    virtual void drag(const Point& xy){
+        if(!draggedOver){ invalidate(); }
+        draggedOver = true;
+    }
+    virtual void dragEnd(){
+        if(draggedOver){ invalidate(); }
+        draggedOver = false;
+    }
     // another object was dropped on top of this one
     virtual bool dropped(const Point& xy, std::shared_ptr<Object>const & obj){ return false; }
+private:
+    std::unique_ptr<RetainedImage> retained;
+    bool scadDirty = true;
+    bool scadOk = false;
+    std::string scadCode; // saved by writeScad()
 };
 
 
 // Left-to-right flow layout without scrolling.
 // Used in top menu and to contain operators' children
+// If width is 0, all children are placed in one row and the layout grows to fit them
 class FlowLayout: public Object {
 protected:
     std::vector<std::shared_ptr<Object>> children;
     bool disableDragDrop = false;
+    bool autoWidth = false;
+    int flow(const Point& xy, bool place); // wraps children into rows starting at xy.  Returns height
+    std::vector<std::shared_ptr<Object>>::iterator eraseChild(std::vector<std::shared_ptr<Object>>::iterator it);
+    virtual const std::vector<int>& childrenAt(const Point& xy); // indexes of children containing xy
+    std::vector<int> hits; // returned by childrenAt()
+    RectArray rects; // copy of children's locations for hit-testing and culling
+    std::vector<int> drawn; // children overlapping the clip rectangle in draw()
+    void updateGeometry(int first, int end); // copies locations of children in [first,end) to rects if any child moved
+    bool geometryDirty = true;
+private:
+    SpatialGrid grid; // index of children's locations.  Used when there are many children
+    bool gridDirty = true;
 public:
-    FlowLayout(int width, bool disDragDrop=false): disableDragDrop(disDragDrop) { loc.w = width; }
-    void addObject(std::shared_ptr<Object>const & obj);
+    FlowLayout(int width, bool disDragDrop=false): disableDragDrop(disDragDrop), autoWidth(0 == width) { loc.w = width; }
+    void addObject(std::shared_ptr<Object>const & obj){ insertObject(obj, children.size()); }
+    void insertObject(std::shared_ptr<Object>const & obj, size_t index); // can be undone.  See History
+    const std::vector<std::shared_ptr<Object>>& getChildren() const { return children; }
     virtual bool saveScad(std::ostream& file);
+    virtual void saveCsg(CsgBuilder& csg);
+    virtual void measure();
     virtual void setLocation(const Point& xy);
     virtual bool removeChild(std::shared_ptr<Object>& obj);
+    virtual void childGeometryChanged(){ geometryDirty = gridDirty = true; }
     virtual void draw(SDL_Renderer* rend);
     virtual bool dropped(const Point& xy, std::shared_ptr<Object>const & obj);
     virtual std::shared_ptr<Object> takeObject(const Point& xy);
     virtual std::shared_ptr<Object> click (const Point& xy);
     virtual std::shared_ptr<Object> clickr(const Point& xy);
+    virtual void scroll(const Point& xy, int y); // passes it to the child under the mouse
 };
 
 // Vertical Layout will be used in the main frame as "lines" to contain Operator and in the MODULE list
 // fixed horizontal & vertical size. Changes only when main window is resized.
-// scrolls on up()/down() events
+// scrolls on mouse wheel events if children do not fit
+// Only children in the visible part are placed, drawn and hit-tested.  Others keep their old location.
 // It can contain FlowLayout, Operator and Module
 // when window is resized, it resizes in width and height
 // TODO:    void setSize(int H, int W){ loc.h = H; loc.w = W; }
-struct VerticalLayout: public FlowLayout {
+class VerticalLayout: public FlowLayout {
+    int scrollY = 0; // how far the content is scrolled up
+    std::vector<int> tops{0}; // top of each child relative to top of the content.  Last one is content height
+    int firstVisible = 0, endVisible = 0; // range of children that are visible
+public:
     VerticalLayout(int width, int height, bool disDragDrop=false): FlowLayout(width, disDragDrop){ loc.h = height; }
+    virtual void measure();
     virtual void setLocation(const Point& xy);
     virtual void scroll(const Point& xy, int y);
+    virtual void draw(SDL_Renderer* rend);
+    virtual const std::vector<int>& childrenAt(const Point& xy);
 };
 
 struct Labels: public VerticalLayout {
@@ -87,10 +150,15 @@ class Operator;
 // This is an equivalent of OpenScad's module
 class Module: public Object { // does not have children
     std::weak_ptr<Object> parent;
+    std::vector<std::weak_ptr<Object>> shownIn; // copies and views that get the images made later.  Only in the original
 public:
     Module(std::shared_ptr<Object> const & parenT): parent(parenT) { }
     virtual bool saveScad(std::ostream& file);
+    virtual void saveCsg(CsgBuilder& csg);
     virtual std::shared_ptr<Object> clone();
+    virtual void setImage(std::shared_ptr<SDL_Texture> sdlTexture); // also sets it in objects showing this module
+    void showIn(std::shared_ptr<Object> const & obj); // obj shows the image of this module from now on
+    void hideIn(Object* obj); // obj does not show this module any more
     std::shared_ptr<Operator> getOperator();
 };
 
@@ -99,14 +167,30 @@ public:
 // then generate an image from saved text and then call module->setImage()
 class Operator: public Object {
     std::shared_ptr<Module> module; // openscad module
+    int moduleId = 0; // modules are named mod1, mod2... in the order they are created
+    static int lastModuleId;
     FlowLayout layout;
 public:
     enum OperatorType {UNION, DIFFERENCE, INTERSECTION} type;
     Operator(OperatorType ot);
     std::shared_ptr<Module> getModule();
+    void setModuleId(int id); // makes a module with the given id.  Used when loading saved code
+    void removeModule(int lastId); // undoes making the module.  lastId was the last module id before it.  Used by History
+    void restoreModule(std::shared_ptr<Module> const & mod, int id); // makes the same module again.  Used by History
+    std::shared_ptr<Module> getModuleCall(); // clone of the module without making its image
+    void addObject(std::shared_ptr<Object>const & obj){ layout.addObject(obj); } // layout is done later
+    std::string getModuleName() const { return "mod" + std::to_string(moduleId); }
+    int getModuleId() const { return module ? moduleId : 0; }
+    void setModuleImage(std::shared_ptr<SDL_Texture> const & texture){ if(module){ module->setImage(texture); } }
+    void showModuleIn(std::shared_ptr<Object> const & obj){ if(module){ module->showIn(obj); } }
+    void hideModuleIn(Object* obj){ if(module){ module->hideIn(obj); } }
+    const std::vector<std::shared_ptr<Object>>& getChildren() const { return layout.getChildren(); }
     virtual bool saveScad(std::ostream& file);
+    virtual void saveCsg(CsgBuilder& csg); // module definitions do not make any geometry
+    void saveModuleCsg(CsgBuilder& csg); // geometry made by calling the module
     virtual std::shared_ptr<Object> clone();
     virtual bool dropped(const Point& xy, std::shared_ptr<Object>const & obj);
+    virtual void measure();
     virtual void setLocation(const Point& xy);
     virtual void draw(SDL_Renderer* rend);
     virtual std::shared_ptr<Object> click (const Point& xy){ return layout.click(xy); }
@@ -120,34 +204,39 @@ class Input: public Object {  // does not have children
     double value;
     double delta;
     bool enabled;
-    static std::shared_ptr<Text> printer; // writes text to screen
+    static std::shared_ptr<Text> printer; // writes text to screen.  Created on first draw so batch runs open no font
+    std::shared_ptr<SDL_Texture> valueImg; // value printed into a texture.  Regenerated only when value changes
+    double valueImgValue = 0;
+    SDL_Rect valueImgLoc;
 public:
     Input(): value(0), delta(1.0), enabled(true) {
         loc.w = 80;
         loc.h = 16;
-        if(!printer){ // TODO: make printer non-pointer???
-            printer = std::make_shared<Text>(16);
-        }
     }
     void disable(){ enabled = false; }
     virtual void draw(SDL_Renderer* rend);
     virtual std::shared_ptr<Object> click(const Point& xy);
     virtual std::shared_ptr<Object> clickr(const Point& xy); // change it slowly after right click
-    virtual void scroll(const Point& xy, int y){ value += y*delta; }
+    virtual void scroll(const Point& xy, int y){ setValue(value + y*delta); }
     virtual bool saveScad(std::ostream& file);
-    void setValue(double val){ value = val; }
+    double getValue() const { return value; }
+    double getDelta() const { return delta; }
+    void setDelta(double d){ delta = d; }
+    void setValue(double val); // can be undone.  See History
 };
 
-// an object with 3 input fields
+// an object with 3 input fields.  Inputs are embedded to save allocations
 class XYZ: public Object{
 protected:
-    std::shared_ptr<Input> x,y,z;
+    Input x,y,z;
 public:
     XYZ();
     virtual void draw(SDL_Renderer* rend);
     virtual void setLocation(const Point& xy);
     virtual std::shared_ptr<Object> click(const Point& xy);
     virtual std::shared_ptr<Object> clickr(const Point& xy);
+    void setValues(double X, double Y, double Z);
+    Input& getInput(int axis){ return 0 == axis ? x : 1 == axis ? y : z; }
 };
 
 // translate/rotate/scale
@@ -155,6 +244,7 @@ struct Modifier: public XYZ {
     enum ModifierType {TRANSLATE, ROTATE, SCALE} type;
     Modifier(ModifierType mt);
     virtual bool saveScad(std::ostream& file);
+    virtual void saveCsg(CsgBuilder& csg);
     virtual std::shared_ptr<Object> clone();
 };
 
@@ -163,16 +253,18 @@ struct Shape: public XYZ {
     enum ShapeType {CUBE, CYLINDER, SPHERE} type;
     Shape(ShapeType st);
     virtual bool saveScad(std::ostream& file);
+    virtual void saveCsg(CsgBuilder& csg);
     virtual std::shared_ptr<Object> clone();
 };
 
 // These are VIEW and DELETE zones in the upper corners
 // When an Operator is dropped into DELETE, it is deleted if it is unused in the rest of the "code"
 // When a Module is dropped here, module representation (name) is deleted from an Operator and Module list
-// When a module (operator) is dragged into VIEW, it generates and saves OpenScad code into OUTPUT_FILE_SCAD
-// Code in OUTPUT_FILE_SCAD should be opened in OpenScad for real-time display
+// When a module (operator) is dragged into VIEW, its OpenScad code is saved into asm.scad (see ScadSaver::setView())
+// asm.scad should be opened in OpenScad for real-time display.  It is saved again every time the code changes
 class DropZone: public Object { // does not have children
     std::shared_ptr<Object> root;
+    std::weak_ptr<Operator> viewed; // VIEW shows the image of its module
 public:
     enum DZType {VIEW, DELETE} type;
     DropZone(DZType dzt, std::shared_ptr<Object> rootObj): root(rootObj), type(dzt) {
@@ -2,6 +2,10 @@
 #include <iostream>
 #include <fstream>
 #include "object.h"
+#include "csg.h"
+#include "log.h"
+#include "render.h"
+#include "history.h"
 using namespace std;
 
 
@@ -13,11 +17,15 @@ Operator::Operator(OperatorType ot): layout(0), type(ot){
         case INTERSECTION: imgFileName = "img/intersection.png"; break;
     }
     img = ImageLoader::getImage(imgFileName); 
+    layout.container = this;
+    layout.embedded = true;
 }
 
+int Operator::lastModuleId = 0;
+
 bool Operator::saveScad(ostream& file){
     if(module){
-        file << "module mod" << this << "(){" << endl;
+        file << "module " << getModuleName() << "(){" << endl;
     }
     switch(type){
         case UNION: file << "union(){" << endl; break;
@@ -25,45 +33,110 @@ bool Operator::saveScad(ostream& file){
         case INTERSECTION: file << "intersection(){" << endl; break;
         default: break;
     }
-    layout.saveScad(file);
+    layout.writeScad(file);
     file << "}" << endl; // close operator
     if(module){ file << "}" << endl << endl; }
     return true;
 }
 
+void Operator::saveCsg(CsgBuilder& csg){
+    if(!module){ saveModuleCsg(csg); }
+}
+
+void Operator::saveModuleCsg(CsgBuilder& csg){
+    CsgBuilder children;
+    children.depth = csg.depth;
+    layout.saveCsg(children);
+    CsgNode::Type t = CsgNode::UNION;
+    switch(type){
+        case UNION: t = CsgNode::UNION; break;
+        case DIFFERENCE: t = CsgNode::DIFFERENCE; break;
+        case INTERSECTION: t = CsgNode::INTERSECTION; break;
+    }
+    auto node = make_shared<CsgNode>(t);
+    node->children = children.nodes;
+    csg.add(node);
+}
+
 std::shared_ptr<Object> Operator::clone(){
-    auto obj = std::make_shared<Operator>(type);
-    obj->isClone = true;
-    return obj;
+    return makeClone<Operator>(type);
 }
 
 bool Operator::dropped(const Point& xy, std::shared_ptr<Object>const & obj){
     // TODO: check if xy is in loc?
     if(shared_from_this() == obj){ return false; }
     if(!isClone){ return false; } // originals can only be dragged
-    cout << "Adding an object to an operator." << endl;
-    layout.addObject(obj);
-    layout.loc.w += ITEM_WIDTH; // TODO: this is wrong (for 2 reasons!!!)
-    layout.setLocation(Point(loc.x+ITEM_WIDTH*(module?2:1), loc.y));
+    LOG_DEBUG("Adding an object to an operator.");
+    layout.addObject(obj); // layout grows to fit its children
+    setLocation(Point(loc.x, loc.y));
     return true;
 }
 
+void Operator::setModuleId(int id){
+    bool made = !module;
+    int lastId = lastModuleId;
+    if(made){ module = makeObject<Module>(shared_from_this()); }
+    moduleId = id;
+    setRetained(true); // finished operators rarely change
+    lastModuleId = max(lastModuleId, id); // new modules get new names
+    scadChanged(); // code is now wrapped in a module
+    if(made){ History::moduleMade(*this, module, lastId); } // undone by removeModule()
+}
+
+void Operator::removeModule(int lastId){
+    module.reset(); // clones in Labels were removed first.  History keeps the module for redo
+    moduleId = 0;
+    lastModuleId = lastId; // the next module gets the same name again
+    setRetained(false);
+    scadChanged(); // code is not wrapped in a module any more
+}
+
+void Operator::restoreModule(shared_ptr<Module> const & mod, int id){
+    module = mod;
+    setModuleId(id);
+}
+
+std::shared_ptr<Module> Operator::getModuleCall(){
+    if(!module){ return shared_ptr<Module>(); }
+    return static_pointer_cast<Module>(module->clone());
+}
+
 std::shared_ptr<Module> Operator::getModule(){ // not virtual
-    if(!module){ module = std::make_shared<Module>(shared_from_this()); }
+    PROFILE("Operator::getModule");
+    if(!module){
+        setModuleId(lastModuleId+1);
+    }
     if( !ScadSaver::makeObjectImage( module ) ){
-        std::cout << "ERROR while creating module image." << std::endl;
+        LOG_ERROR("can not create module image.");
     }
-    return static_pointer_cast<Module>(module->clone());
+    return getModuleCall();
+}
+
+void Operator::measure(){ // operator's picture on the left followed by its children
+    if(!sizeDirty){ return; }
+    layout.measure();
+    loc.w = ITEM_WIDTH + layout.loc.w;
+    loc.h = max(ITEM_HEIGHT, layout.loc.h);
+    sizeDirty = false;
 }
 
 void Operator::setLocation(const Point& xy){
+    if(!layoutDirty && xy.x == loc.x && xy.y == loc.y){ return; } // children did not change
+    PROFILE("Operator::setLocation");
+    Profiler::count(Profiler::LAYOUT_PASSES);
+    SDL_Rect old = loc;
+    measure();
     Object::setLocation(xy);
     layout.setLocation(Point(xy.x+ITEM_WIDTH, xy.y));
-    loc.w = ITEM_WIDTH + layout.loc.w;
-    loc.h = max(ITEM_HEIGHT, layout.loc.h);
+    if(old.w != loc.w || old.h != loc.h){
+        Damage::add(old);
+        invalidate();
+        geometryChanged();
+    }
 }
 
 void Operator::draw(SDL_Renderer* rend){
+    if(drawRetained(rend)){ return; }
     SDL_Rect r;  // TODO: do this better
     r.x = loc.x;
     r.y = loc.y;
@@ -71,19 +144,13 @@ void Operator::draw(SDL_Renderer* rend){
     r.h = ITEM_HEIGHT;
 
     if(module){
-        SDL_RenderCopy(rend, module->img.get(), NULL, &r);
+        RenderBatch::image(module->img.get(), r);
         r.w = ITEM_WIDTH/3;
         r.h = ITEM_HEIGHT/3;
-        SDL_RenderCopy(rend, img.get(), NULL, &r); // operator on top of module
+        RenderBatch::image(img.get(), r, RenderBatch::OVERLAYS); // operator on top of module
     } else {
-        SDL_RenderCopy(rend, img.get(), NULL, &r);
+        RenderBatch::image(img.get(), r);
     }
     layout.draw(rend);
-
-    if(draggedOver){
-        SDL_SetRenderDrawColor(rend,255,0,0,255);
-    } else {
-        SDL_SetRenderDrawColor(rend,255,255,255,255);
-    }
-    SDL_RenderDrawRect(rend, &loc);
+    RenderBatch::outline(loc, draggedOver);
 }
@@ -0,0 +1,57 @@
+#include <iostream>
+#include "pool.h"
+using namespace std;
+
+static const size_t POOL_COUNT = Pool::MAX_BLOCK / Pool::GRANULARITY;
+static Pool* pools[POOL_COUNT]; // never deleted.  Objects may be released by static destructors at exit
+
+static bool makePools(){
+    for(size_t i = 0; i < POOL_COUNT; ++i){ pools[i] = new Pool((i+1)*Pool::GRANULARITY); }
+    return true;
+}
+
+Pool* Pool::forSize(size_t size){
+    static bool made = makePools(); // thread safe since c++11
+    (void)made;
+    if(0 == size || size > MAX_BLOCK){ return nullptr; }
+    return pools[(size-1)/GRANULARITY];
+}
+
+void* Pool::allocate(){
+    lock_guard<std::mutex> lock(mutex);
+    if(!freeList){ // carve a new chunk into blocks
+        char* chunk = static_cast<char*>( ::operator new(CHUNK_SIZE) );
+        chunks.push_back(chunk);
+        for(size_t offset = CHUNK_SIZE/blockSize*blockSize; offset > 0; offset -= blockSize){
+            void* block = chunk + offset - blockSize;
+            *static_cast<void**>(block) = freeList;
+            freeList = block;
+        }
+    }
+    void* block = freeList;
+    freeList = *static_cast<void**>(block);
+    ++allocations;
+    peak = max(peak, ++used);
+    return block;
+}
+
+void Pool::deallocate(void* block){
+    if(!block){ return; }
+    lock_guard<std::mutex> lock(mutex);
+    *static_cast<void**>(block) = freeList;
+    freeList = block;
+    --used;
+}
+
+void Pool::report(ostream& out){
+    size_t held = 0;
+    for(size_t size = GRANULARITY; size <= MAX_BLOCK; size += GRANULARITY){
+        Pool* p = forSize(size);
+        lock_guard<std::mutex> lock(p->mutex);
+        if(p->chunks.empty()){ continue; }
+        out << "Pool " << p->blockSize << " bytes: " << p->used << " blocks used (peak " << p->peak << "), "
+            << p->allocations << " allocations, " << p->chunks.size()*CHUNK_SIZE << " bytes reserved" << endl;
+        held += p->chunks.size()*CHUNK_SIZE;
+    }
+    out << "Pools: " << held << " bytes reserved" << endl;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Fixed size blocks cut out of big chunks.  A freed block is reused by the next allocation of the same size.
+// There is one pool per size class.  Chunks are kept until the program exits because
+// editing keeps creating and deleting objects of the same few types.
+class Pool {
+    size_t blockSize;
+    void* freeList = nullptr; // freed blocks.  Each one stores a pointer to the next one
+    std::vector<char*> chunks;
+    size_t used = 0, peak = 0; // blocks in use
+    unsigned long long allocations = 0;
+    std::mutex mutex; // objects live on the UI thread but a worker may drop the last weak_ptr to one
+public:
+    static const size_t GRANULARITY = 16; // block sizes are multiples of this.  Also their alignment
+    static const size_t MAX_BLOCK = 1024; // bigger blocks come from operator new
+    static const size_t CHUNK_SIZE = 64*1024;
+    Pool(size_t size): blockSize(size) {}
+    static Pool* forSize(size_t size); // nullptr if size is bigger than MAX_BLOCK
+    void* allocate();
+    void deallocate(void* block);
+    static void report(std::ostream& out); // print blocks in use and memory held by each pool
+};
+
+// allocator for std::allocate_shared().  Single objects come from pools, arrays from operator new
+template<class T> struct PoolAllocator {
+    typedef T value_type;
+    PoolAllocator(){}
+    template<class U> PoolAllocator(const PoolAllocator<U>&){}
+    T* allocate(size_t n){
+        Pool* pool = 1 == n ? Pool::forSize(sizeof(T)) : nullptr;
+        return static_cast<T*>( pool ? pool->allocate() : ::operator new(n*sizeof(T)) );
+    }
+    void deallocate(T* p, size_t n){
+        Pool* pool = 1 == n ? Pool::forSize(sizeof(T)) : nullptr;
+        if(pool){ pool->deallocate(p); } else { ::operator delete(p); }
+    }
+};
+template<class T, class U> bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&){ return true; }
+template<class T, class U> bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&){ return false; }
+
+// same as std::make_shared() but the object and its reference counts share one pooled block.
+// Only the allocation is pooled: objects are still owned by shared_ptr with atomic reference counts.  That costs 40
+// bytes per node (bench node_size) and no reference counting in draw() and saveScad(), which walk children by reference
+template<class T, class... Args> std::shared_ptr<T> makeObject(Args&&... args){
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+// pooled object marked as a clone.  Used by clone() and by code restoring saved objects
+template<class T, class... Args> std::shared_ptr<T> makeClone(Args&&... args){
+    auto obj = makeObject<T>(std::forward<Args>(args)...);
+    obj->isClone = true;
+    return obj;
+}
@@ -0,0 +1,401 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <list>
+#include <functional>
+#include <unordered_map>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#include <process.h>
+#include <direct.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#include "preview.h"
+#include "object.h"
+#include "csg.h"
+#include "log.h"
+using namespace std;
+const string CACHE_DIR = "cache";
+const size_t CACHE_TEXTURES = 64; // how many textures are kept in memory
+
+
+static unsigned long cacheHits = 0, diskHits = 0, cacheMisses = 0;
+static unsigned long long bytesOnDisk = 0;
+static bool diskScanned = false;
+typedef list<pair<string, shared_ptr<SDL_Texture>>> LruList;
+static LruList lru; // most recently used in front
+static unordered_map<string, LruList::iterator> lruIndex;
+static unordered_map<string, long long> fileSizes; // by key: files counted in bytesOnDisk
+
+static long long fileSize(const string& fileName){
+    struct stat st;
+    return 0 == stat(fileName.c_str(), &st) ? st.st_size : -1;
+}
+
+// create CACHE_DIR and find out how much space it takes
+static void scanDisk(){
+    if(diskScanned){ return; }
+    diskScanned = true;
+#ifdef _WIN32
+    _mkdir(CACHE_DIR.c_str());
+#else
+    mkdir(CACHE_DIR.c_str(), 0755);
+#endif
+    DIR* dir = opendir(CACHE_DIR.c_str());
+    if(!dir){ return; }
+    while(dirent* entry = readdir(dir)){
+        string name = entry->d_name;
+        long long size = fileSize(CACHE_DIR + "/" + name);
+        if(name[0] == '.' || size <= 0){ continue; }
+        bytesOnDisk += size;
+        size_t dot = name.find_last_of('.');
+        fileSizes[name.substr(0, dot)] = size; // key.png
+    }
+    closedir(dir);
+}
+
+static void remember(const string& key, shared_ptr<SDL_Texture> const & texture){
+    auto it = lruIndex.find(key);
+    if(it != lruIndex.end()){ lru.erase(it->second); }
+    lru.push_front( make_pair(key, texture) );
+    lruIndex[key] = lru.begin();
+    if(lru.size() > CACHE_TEXTURES){
+        lruIndex.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+static unsigned long long fnv(const string& text, unsigned long long hash = 14695981039346656037ULL){ // 64 bit FNV-1a
+    for(unsigned char c: text){
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static string keyString(unsigned long long hash, size_t size){
+    char buff[32];
+    snprintf(buff, sizeof(buff), "%016llx", hash);
+    return string(buff) + "_" + to_string(size); // length makes collisions even less likely
+}
+
+string ThumbnailCache::key(const string& scadCode){
+    return keyString(fnv(scadCode), scadCode.size());
+}
+
+unsigned long long ThumbnailCache::hash(const string& scadCode){
+    return fnv(scadCode);
+}
+
+string ThumbnailCache::key(unsigned long long codeHash, size_t codeSize, const string& more){
+    return keyString(fnv(more, codeHash), codeSize + more.size());
+}
+
+string ThumbnailCache::path(const string& key){
+    return CACHE_DIR + "/" + key + ".png";
+}
+
+shared_ptr<SDL_Texture> ThumbnailCache::get(const string& key){
+    scanDisk();
+    auto it = lruIndex.find(key);
+    if(it != lruIndex.end()){
+        ++cacheHits;
+        lru.splice(lru.begin(), lru, it->second); // move to front
+        return it->second->second;
+    }
+    if(fileSize(path(key)) > 0){
+        auto texture = ImageLoader::loadImage(path(key));
+        if(texture){
+            ++diskHits;
+            remember(key, texture);
+            return texture;
+        }
+    }
+    ++cacheMisses;
+    return nullptr;
+}
+
+void ThumbnailCache::put(const string& key, shared_ptr<SDL_Texture> const & texture){
+    scanDisk();
+    long long size = fileSize(path(key));
+    if(size > 0){ // the same key may be put again.  Its file was replaced
+        long long& counted = fileSizes[key];
+        bytesOnDisk += size - counted;
+        counted = size;
+    }
+    remember(key, texture);
+}
+
+void ThumbnailCache::report(ostream& out){
+    unsigned long total = cacheHits + diskHits + cacheMisses;
+    out << "Thumbnail cache: " << cacheHits << " memory hits, " << diskHits << " disk hits, " << cacheMisses << " misses";
+    if(total){ out << " (" << (100*(cacheHits+diskHits))/total << "% hit rate)"; }
+    out << ", " << bytesOnDisk << " bytes in " << CACHE_DIR << "/" << endl;
+}
+
+
+struct PreviewJob {
+    unsigned long id;
+    Object* key; // identifies jobs rendering the same object.  Never dereferenced
+    weak_ptr<Object> obj;
+    string scad;
+    string cacheKey;
+    string scadFile; // temporary files
+    string imgFile;
+    long pid = 0; // openscad process id while it is running
+    bool cancelled = false;
+    bool ok = false;
+    Uint32 submitted = 0; // SDL_GetTicks()
+};
+
+static mutex mtx;
+static condition_variable cv;
+static deque<shared_ptr<PreviewJob>> pending;
+static vector<shared_ptr<PreviewJob>> running;
+static deque<shared_ptr<PreviewJob>> done;
+static vector<thread> workers;
+static bool stopping = false;
+static unsigned long nextJobId = 0;
+
+Uint32 PreviewQueue::doneEvent = (Uint32)-1;
+
+
+static void killProcess(long pid){
+#ifndef _WIN32
+    if(pid > 0){ kill(pid, SIGTERM); }
+#endif
+}
+
+bool Openscad::run(const string& scadFile, const string& outFile, function<void(long)> started, int timeoutSeconds){
+    PROFILE("openscad");
+#ifdef _WIN32 // no way to kill it.  timeoutSeconds is ignored
+    string cmd = "openscad --viewall --autocenter -o "+outFile+" "+scadFile;
+    return 0 == system(cmd.c_str());
+#else
+    pid_t pid = fork();
+    if(pid < 0){ return false; }
+    if(0 == pid){ // child
+        setpgid(0, 0); // own process group so that a timeout kills whatever openscad started too
+        execlp("openscad", "openscad", "--viewall", "--autocenter", "-o", outFile.c_str(), scadFile.c_str(), (char*)NULL);
+        _exit(127); // openscad was not found
+    }
+    if(started){ started(pid); }
+    // wait without reaping it so that pid can not be reused by another process yet
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(timeoutSeconds);
+    while(true){
+        siginfo_t info;
+        info.si_pid = 0; // stays 0 if WNOHANG finds it running
+        if(waitid(P_PID, pid, &info, WEXITED | WNOWAIT | (timeoutSeconds > 0 ? WNOHANG : 0)) < 0){
+            if(errno == EINTR){ continue; }
+            break;
+        }
+        if(info.si_pid){ break; } // exited
+        if(chrono::steady_clock::now() < deadline){
+            this_thread::sleep_for(chrono::milliseconds(20));
+            continue;
+        }
+        LOG_WARN("openscad " << scadFile << " took longer than " << timeoutSeconds << "s.  Killed");
+        kill(-pid, SIGKILL);
+        timeoutSeconds = 0; // wait until it is gone
+    }
+    if(started){ started(0); } // nobody kills pid after this
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR){}
+    return WIFEXITED(status) && 0 == WEXITSTATUS(status);
+#endif
+}
+
+// runs openscad and returns true if it succeeded.  Results of cancelled jobs are thrown away
+static bool runOpenscad(shared_ptr<PreviewJob> const & job){
+    bool ok = Openscad::run(job->scadFile, job->imgFile, [&](long pid){
+        lock_guard<mutex> lock(mtx);
+        job->pid = pid;
+        if(job->cancelled){ killProcess(pid); } // cancelled while we were starting it
+    });
+    return ok;
+}
+
+static void worker(){
+    while(true){
+        shared_ptr<PreviewJob> job;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, []{ return stopping || !pending.empty(); });
+            if(stopping){ return; }
+            job = pending.front();
+            pending.pop_front();
+            running.push_back(job);
+        }
+
+        ofstream file(job->scadFile, ios_base::out | ios::trunc);
+        file << job->scad;
+        file.close();
+        bool ok = file.good() && runOpenscad(job);
+        remove(job->scadFile.c_str());
+        if(ok){ // move it into the cache in one step so that a half written image is never seen
+            string cached = ThumbnailCache::path(job->cacheKey);
+#ifdef _WIN32
+            remove(cached.c_str()); // rename() does not overwrite on windows
+#endif
+            ok = 0 == rename(job->imgFile.c_str(), cached.c_str());
+        }
+
+        bool cancelled;
+        {
+            lock_guard<mutex> lock(mtx);
+            running.erase( find(begin(running), end(running), job) );
+            cancelled = job->cancelled;
+            job->ok = ok;
+            if(!cancelled){ done.push_back(job); }
+        }
+        if(cancelled){
+            remove(job->imgFile.c_str());
+            continue;
+        }
+        SDL_Event e;
+        SDL_memset(&e, 0, sizeof(e));
+        e.type = PreviewQueue::doneEvent;
+        SDL_PushEvent(&e); // SDL_PushEvent() is thread safe
+    }
+}
+
+void PreviewQueue::start(int count){
+    if(doneEvent == (Uint32)-1){ doneEvent = SDL_RegisterEvents(1); }
+    stopping = false;
+    for(int i = 0; i < max(1,count); ++i){
+        workers.push_back( thread(worker) );
+    }
+    LOG_INFO("Started " << workers.size() << " openscad preview workers.");
+}
+
+void PreviewQueue::stop(){
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+        for(auto& job: running){
+            job->cancelled = true;
+            killProcess(job->pid);
+        }
+        pending.clear();
+    }
+    cv.notify_all();
+    for(auto& t: workers){ t.join(); }
+    workers.clear();
+    for(auto& job: done){ remove(job->imgFile.c_str()); }
+    done.clear();
+}
+
+// results of previous jobs for this object are stale.  mtx has to be locked
+static void cancelJobs(Object* key){
+    pending.erase( remove_if(begin(pending), end(pending), [&](shared_ptr<PreviewJob>& j){ return j->key == key; }), end(pending) );
+    for(auto& j: running){
+        if(j->key != key){ continue; }
+        j->cancelled = true;
+        killProcess(j->pid);
+    }
+    for(auto& j: done){
+        if(j->key == key){ j->cancelled = true; }
+    }
+}
+
+void PreviewQueue::cancel(shared_ptr<Object> const & obj){
+    lock_guard<mutex> lock(mtx);
+    cancelJobs(obj.get());
+}
+
+void PreviewQueue::submit(shared_ptr<Object> const & obj, const string& scadCode, const string& cacheKey){
+    scanDisk(); // makes sure CACHE_DIR exists
+    auto job = make_shared<PreviewJob>();
+    job->key = obj.get();
+    job->obj = obj;
+    job->scad = scadCode;
+    job->cacheKey = cacheKey;
+    job->submitted = SDL_GetTicks();
+    {
+        lock_guard<mutex> lock(mtx);
+        job->id = ++nextJobId;
+        stringstream name; // unique per editor instance and per job
+        name << "tmp" << getpid() << "_" << job->id;
+        job->scadFile = name.str() + ".scad";
+        job->imgFile = name.str() + ".png";
+        cancelJobs(job->key);
+        pending.push_back(job);
+    }
+    cv.notify_one();
+    if(workers.empty()){
+        LOG_ERROR("preview workers were not started.");
+    }
+}
+
+int PreviewQueue::poll(){
+    deque<shared_ptr<PreviewJob>> finished;
+    {
+        lock_guard<mutex> lock(mtx);
+        finished.swap(done);
+    }
+    int updated = 0;
+    for(auto& job: finished){
+        if(!job->ok){
+            if(!job->cancelled){ LOG_ERROR("openscad job " << job->id << " failed."); }
+            remove(job->imgFile.c_str());
+            continue;
+        }
+        auto texture = ImageLoader::loadImage( ThumbnailCache::path(job->cacheKey) );
+        if(!texture){ continue; }
+        ThumbnailCache::put(job->cacheKey, texture); // cache it even if the job was cancelled
+        auto obj = job->obj.lock();
+        if(!job->cancelled && obj){
+            obj->setImage(texture);
+            ++updated;
+            LOG_DEBUG("openscad job " << job->id << " took " << SDL_GetTicks()-job->submitted << "ms");
+        }
+    }
+    return updated;
+}
+
+shared_ptr<SDL_Texture> PreviewQueue::placeholder(){
+    static shared_ptr<SDL_Texture> texture;
+    if(texture){ return texture; }
+    SDL_Surface* s = SDL_CreateRGBSurfaceWithFormat(0, ITEM_WIDTH, ITEM_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if(!s){ return texture; }
+    SDL_FillRect(s, NULL, SDL_MapRGB(s->format, 64, 64, 64));
+    SDL_Rect bar = { ITEM_WIDTH/4, ITEM_HEIGHT/2-2, ITEM_WIDTH/2, 4 }; // "in progress" bar
+    SDL_FillRect(s, &bar, SDL_MapRGB(s->format, 160, 160, 160));
+    texture = ImageLoader::getImage(s);
+    SDL_FreeSurface(s);
+    return texture;
+}
+
+
+bool CsgPreviewer::preview(shared_ptr<Object> const & obj, shared_ptr<Operator> const & op, const string& scadCode, const string& call, const string& cacheKey){
+    PROFILE("CsgPreviewer::preview");
+    CsgBuilder csg;
+    op->saveModuleCsg(csg);
+    SDL_Surface* surface = renderCsg(csg.nodes, ITEM_WIDTH, ITEM_HEIGHT);
+    if(!surface){ return false; } // nothing to see
+    auto texture = ImageLoader::getImage(surface);
+    SDL_FreeSurface(surface);
+    if(!texture){ return false; }
+    obj->setImage(texture);
+    return true;
+}
+
+bool OpenscadPreviewer::preview(shared_ptr<Object> const & obj, shared_ptr<Operator> const & op, const string& scadCode, const string& call, const string& cacheKey){
+    PreviewQueue::submit(obj, scadCode + call, cacheKey); // PreviewQueue::poll() sets the image when it is done
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <string>
+#include <memory>
+#include <iostream>
+#include <functional>
+
+class Object;
+
+// Module images keyed by a hash of the exact openscad code they were rendered from.
+// PNG files are kept in CACHE_DIR across sessions.  Recently used textures are also kept in memory.
+class ThumbnailCache {
+public:
+    static std::string key(const std::string& scadCode); // hash of the code as a hex string
+    // key(scadCode + more) where codeHash = hash(scadCode).  Modules share the code and differ only in the call at the end
+    static unsigned long long hash(const std::string& scadCode);
+    static std::string key(unsigned long long codeHash, size_t codeSize, const std::string& more);
+    static std::string path(const std::string& key); // where the image for this key is stored on disk
+    static std::shared_ptr<SDL_Texture> get(const std::string& key); // returns empty pointer if not cached
+    static void put(const std::string& key, std::shared_ptr<SDL_Texture> const & texture); // file is already in path(key)
+    static void report(std::ostream& out); // print hit rate and disk usage
+};
+
+
+// Renders module images by running openscad in background worker threads.
+// Each job uses its own temporary files.  Submitting a new job for an object cancels
+// its queued job and kills its running openscad process since that result is stale.
+// Finished images are loaded on the UI thread by calling PreviewQueue::poll()
+// this class has to be initialized by calling PreviewQueue::start()
+class PreviewQueue {
+public:
+    static Uint32 doneEvent; // SDL event pushed when a job finishes to wake up the main loop
+    static void start(int workers);
+    static void stop(); // kills running openscad processes and waits for workers to exit
+    // render scadCode into ThumbnailCache::path(cacheKey) and set it as obj's image
+    static void submit(std::shared_ptr<Object> const & obj, const std::string& scadCode, const std::string& cacheKey);
+    static void cancel(std::shared_ptr<Object> const & obj); // obj does not need a new image any more
+    static int poll(); // set images of objects whose jobs finished.  Returns number of updated objects
+    static std::shared_ptr<SDL_Texture> placeholder(); // shown until the image arrives
+};
+
+
+// Runs the openscad program.  Used by PreviewQueue and Batch
+class Openscad {
+public:
+    // render scadFile into outFile.  Its extension selects the format (.png, .stl...).  Blocks until openscad exits.
+    // started() gets the process id while it runs so that other threads can kill it.  It is called again with 0 after
+    // the process exited and before it is reaped, so a killed pid always belongs to openscad.  If timeoutSeconds > 0 openscad
+    // is killed when it runs longer.  Returns true if openscad succeeded
+    static bool run(const std::string& scadFile, const std::string& outFile, std::function<void(long pid)> started = nullptr,
+                    int timeoutSeconds = 0);
+};
+
+
+class Operator;
+
+// Common interface of the ways module images are made.
+// ScadSaver::makeObjectImage() asks previewers in the order they were added by ScadSaver::addPreviewer()
+class Previewer {
+public:
+    virtual ~Previewer(){}
+    // make an image of op's module for obj.  scadCode defines all modules, call calls op's module
+    // and cacheKey is the hash of both.  Returns false if no image was or will be made
+    virtual bool preview(std::shared_ptr<Object> const & obj, std::shared_ptr<Operator> const & op,
+                         const std::string& scadCode, const std::string& call, const std::string& cacheKey) = 0;
+};
+
+// Approximate image ray-marched in-process (see csg.h).  Takes milliseconds so the image is set right away
+class CsgPreviewer: public Previewer {
+public:
+    virtual bool preview(std::shared_ptr<Object> const & obj, std::shared_ptr<Operator> const & op,
+                         const std::string& scadCode, const std::string& call, const std::string& cacheKey);
+};
+
+// Exact image rendered by openscad in the background (see PreviewQueue).  It replaces the current image when done
+class OpenscadPreviewer: public Previewer {
+public:
+    virtual bool preview(std::shared_ptr<Object> const & obj, std::shared_ptr<Operator> const & op,
+                         const std::string& scadCode, const std::string& call, const std::string& cacheKey);
+};
@@ -0,0 +1,144 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "profile.h"
+#include "sdltext.h"
+#include "log.h"
+#include "render.h"
+using namespace std;
+
+struct TraceEvent {
+    const char* name; // string literal passed to PROFILE()
+    long long start, duration; // microseconds
+    int thread;
+};
+
+static const size_t MAX_EVENTS = 1000000; // about 24MB.  Later events are dropped
+static atomic<bool> tracing(false);
+static mutex mtx; // protects events
+static vector<TraceEvent> events;
+static unsigned long dropped = 0;
+static atomic<int> threads(0);
+static thread_local int threadId = ++threads;
+
+unsigned long Profiler::counters[COUNTERS];
+long long Profiler::imageLatency = -1;
+static unsigned long lastFrame[Profiler::COUNTERS]; // counters of the last frame
+static long long frameStart = 0, frameTime = 0;
+static unsigned lastLatency = 0, maxLatency = 0; // milliseconds from input to present
+static unsigned long latencySum = 0, latencyCount = 0;
+
+long long Profiler::now(){
+    static const auto start = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+void Profiler::startTrace(){
+    lock_guard<mutex> lock(mtx);
+    events.reserve(64*1024);
+    tracing = true;
+}
+
+bool Profiler::isTracing(){
+    return tracing;
+}
+
+void Profiler::record(const char* name, long long start, long long end){
+    lock_guard<mutex> lock(mtx);
+    if(events.size() >= MAX_EVENTS){
+        ++dropped;
+        return;
+    }
+    events.push_back({name, start, end-start, threadId});
+}
+
+bool Profiler::saveTrace(const string& fileName){
+    lock_guard<mutex> lock(mtx);
+    string tmpFile = fileName + ".tmp";
+    ofstream file(tmpFile, ios_base::out | ios::trunc);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for(size_t i = 0; i < events.size(); ++i){ // "X" is an event with a duration.  Names are literals without quotes
+        auto& e = events[i];
+        file << (i ? ",\n" : "\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+             << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << "}";
+    }
+    file << "\n]}\n";
+    file.close();
+    if(!file.good()){
+        LOG_ERROR("can not write trace " << tmpFile);
+        remove(tmpFile.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    remove(fileName.c_str()); // rename() does not overwrite on windows
+#endif
+    if(0 != rename(tmpFile.c_str(), fileName.c_str())){
+        LOG_ERROR("can not rename " << tmpFile << " to " << fileName);
+        return false;
+    }
+    LOG_INFO("Saved " << events.size() << " trace events to " << fileName << " (" << dropped << " dropped)");
+    return true;
+}
+
+void Profiler::frameBegin(){
+    frameStart = now();
+}
+
+void Profiler::frameEnd(){
+    frameTime = now() - frameStart; // time spent making the frame.  Waiting for events is not included
+    for(int i = 0; i < COUNTERS; ++i){
+        lastFrame[i] = counters[i];
+        counters[i] = 0;
+    }
+}
+
+void Profiler::inputPresented(unsigned milliseconds){
+    lastLatency = milliseconds;
+    maxLatency = max(maxLatency, milliseconds);
+    latencySum += milliseconds;
+    ++latencyCount;
+}
+
+void Profiler::report(ostream& out){
+    out << "Input to present ms avg: " << (latencyCount ? double(latencySum)/latencyCount : 0.0) << " max: " << maxLatency
+        << " frames: " << latencyCount << endl;
+}
+
+void Profiler::drawHud(SDL_Renderer* rend){
+    static unique_ptr<Text> printer; // created on first use since it needs the font
+    if(!printer){ printer.reset(new Text(12)); }
+    const int LINES = 7;
+    char lines[LINES][64];
+    snprintf(lines[0], sizeof(lines[0]), "frame %.2f ms", frameTime/1000.0);
+    snprintf(lines[1], sizeof(lines[1]), "draw calls %lu of %lu", lastFrame[DRAW_CALLS], lastFrame[DRAW_COMMANDS]); // batched of submitted
+    snprintf(lines[2], sizeof(lines[2]), "layout passes %lu", lastFrame[LAYOUT_PASSES]);
+    snprintf(lines[3], sizeof(lines[3]), "nodes per hit-test %.1f",
+             lastFrame[HIT_TESTS] ? double(lastFrame[HIT_TEST_NODES])/lastFrame[HIT_TESTS] : 0.0);
+    if(imageLatency < 0){
+        snprintf(lines[4], sizeof(lines[4]), "module image -");
+    } else {
+        snprintf(lines[4], sizeof(lines[4]), "module image %.2f ms", imageLatency/1000.0);
+    }
+    snprintf(lines[5], sizeof(lines[5]), "retained %.1f of %.0f MB", RetainedImage::memory()/1048576.0, RetainedImage::limit()/1048576.0);
+    snprintf(lines[6], sizeof(lines[6]), "input to present %u ms", lastLatency);
+    int lineHeight = printer->getHeightPixels();
+    SDL_Rect box = {0, 0, 200, LINES*lineHeight + 8};
+    int w = 0, h = 0;
+    SDL_GetRendererOutputSize(rend, &w, &h);
+    box.x = w - box.w;
+    box.y = h - box.h;
+    SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(rend, 0, 0, 0, 192);
+    SDL_RenderFillRect(rend, &box);
+    SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_NONE);
+    for(int i = 0; i < LINES; ++i){
+        printer->print(lines[i], box.x + 6, box.y + 4 + i*lineHeight, rend);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <string>
+#include <iostream>
+
+// Scoped timers and per frame counters for finding out what makes the editor slow.
+// PROFILE("name") times the rest of the enclosing scope.  Timers are recorded only while tracing.
+// The trace is saved in Chrome's trace event format.  Open it in chrome://tracing or ui.perfetto.dev
+// Counters are always kept.  Profiler::drawHud() shows the ones from the last frame on top of the screen.
+class Profiler {
+public:
+    enum Counter {DRAW_CALLS, DRAW_COMMANDS, LAYOUT_PASSES, HIT_TESTS, HIT_TEST_NODES, COUNTERS};
+    static unsigned long counters[COUNTERS]; // of the frame being made
+    static void count(Counter c, unsigned long n = 1){ counters[c] += n; }
+    static long long now(); // microseconds since start
+    static void startTrace(); // record timers from now on
+    static bool isTracing();
+    static void record(const char* name, long long start, long long end); // called by ScopedTimer
+    static bool saveTrace(const std::string& fileName); // returns false on error
+    static void imageMade(long long microseconds){ imageLatency = microseconds; } // by ScadSaver::makeObjectImage()
+    static void inputPresented(unsigned milliseconds); // time from the oldest input event handled in a frame until it was presented
+    static void frameBegin(); // call when the main loop wakes up
+    static void frameEnd(); // call after the frame is presented.  Counters start over for the next frame
+    static void drawHud(SDL_Renderer* rend); // counters of the last frame
+    static void report(std::ostream& out); // input latency of the whole session
+private:
+    static long long imageLatency;
+};
+
+struct ScopedTimer {
+    const char* name;
+    long long start;
+    ScopedTimer(const char* namE): name(namE), start(Profiler::isTracing() ? Profiler::now() : -1) {}
+    ~ScopedTimer(){ if(start >= 0){ Profiler::record(name, start, Profiler::now()); } }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE(name) ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(name)
@@ -0,0 +1,228 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "render.h"
+#include "profile.h"
+#include "object.h"
+#include "log.h"
+using namespace std;
+
+struct Command {
+    RenderBatch::Layer layer;
+    SDL_Texture* texture; // null for rectangles
+    Uint32 color;         // RGBA of rectangles
+    SDL_Rect rect;
+};
+
+static vector<Command> batch; // of the current batch
+static vector<SDL_Rect> rects;   // reused by flush()
+static vector<SDL_Vertex> vertices;
+static vector<int> indices;
+unsigned long RenderBatch::commandCount = 0, RenderBatch::callCount = 0;
+int RenderBatch::originX = 0, RenderBatch::originY = 0;
+
+static Uint32 rgba(const SDL_Color& c){ return Uint32(c.r) << 24 | Uint32(c.g) << 16 | Uint32(c.b) << 8 | c.a; }
+
+static SDL_Rect moved(const SDL_Rect& r, int dx, int dy){ return { r.x+dx, r.y+dy, r.w, r.h }; }
+
+void RenderBatch::image(SDL_Texture* texture, const SDL_Rect& rect, Layer layer){
+    if(!texture){ return; }
+    batch.push_back({layer, texture, 0, moved(rect, -originX, -originY)});
+}
+
+void RenderBatch::fill(const SDL_Rect& rect, const SDL_Color& color){
+    batch.push_back({FILLS, nullptr, rgba(color), moved(rect, -originX, -originY)});
+}
+
+void RenderBatch::outline(const SDL_Rect& rect, const SDL_Color& color, Layer layer){
+    batch.push_back({layer, nullptr, rgba(color), moved(rect, -originX, -originY)});
+}
+
+void RenderBatch::outline(const SDL_Rect& rect, bool draggedOver){
+    if(draggedOver){
+        outline(rect, DRAGGED_OVER_COLOR, HIGHLIGHTS);
+    } else {
+        outline(rect, OUTLINE_COLOR);
+    }
+}
+
+void RenderBatch::setClip(SDL_Renderer* rend, const SDL_Rect* clip){
+    flush(rend);
+    if(!clip){
+        SDL_RenderSetClipRect(rend, NULL);
+        return;
+    }
+    SDL_Rect r = moved(*clip, -originX, -originY);
+    SDL_RenderSetClipRect(rend, &r);
+}
+
+bool RenderBatch::getClip(SDL_Renderer* rend, SDL_Rect& clip){
+    if(!SDL_RenderIsClipEnabled(rend)){ return false; }
+    SDL_RenderGetClipRect(rend, &clip);
+    clip = moved(clip, originX, originY);
+    return true;
+}
+
+static void addQuad(const SDL_Rect& r){
+    const SDL_Color WHITE = { 255, 255, 255, SDL_ALPHA_OPAQUE }; // texture colors are not changed
+    int first = vertices.size();
+    float x0 = r.x, y0 = r.y, x1 = r.x+r.w, y1 = r.y+r.h;
+    vertices.push_back({ {x0,y0}, WHITE, {0,0} });
+    vertices.push_back({ {x1,y0}, WHITE, {1,0} });
+    vertices.push_back({ {x1,y1}, WHITE, {1,1} });
+    vertices.push_back({ {x0,y1}, WHITE, {0,1} });
+    int quad[] = { first, first+1, first+2, first, first+2, first+3 };
+    indices.insert(indices.end(), begin(quad), end(quad));
+}
+
+void RenderBatch::flush(SDL_Renderer* rend){
+    if(batch.empty()){ return; }
+    commandCount += batch.size();
+    unsigned long calls = 0;
+    stable_sort(batch.begin(), batch.end(), [](const Command& a, const Command& b){
+        if(a.layer != b.layer){ return a.layer < b.layer; }
+        if(a.texture != b.texture){ return a.texture < b.texture; }
+        return a.color < b.color;
+    });
+    for(size_t i = 0; i < batch.size(); ){ // one call for each run of commands with the same state
+        const Command& first = batch[i];
+        size_t end = i;
+        while(end < batch.size() && batch[end].layer == first.layer && batch[end].texture == first.texture && batch[end].color == first.color){ ++end; }
+        if(first.texture){
+            if(end - i == 1){
+                SDL_RenderCopy(rend, first.texture, NULL, &first.rect);
+            } else {
+                vertices.clear();
+                indices.clear();
+                for(size_t c = i; c < end; ++c){ addQuad(batch[c].rect); }
+                SDL_RenderGeometry(rend, first.texture, vertices.data(), vertices.size(), indices.data(), indices.size());
+            }
+        } else {
+            rects.clear();
+            for(size_t c = i; c < end; ++c){ rects.push_back(batch[c].rect); }
+            SDL_SetRenderDrawColor(rend, first.color >> 24, first.color >> 16 & 0xFF, first.color >> 8 & 0xFF, first.color & 0xFF);
+            if(FILLS == first.layer){
+                SDL_RenderFillRects(rend, rects.data(), rects.size());
+            } else {
+                SDL_RenderDrawRects(rend, rects.data(), rects.size());
+            }
+            ++calls; // setting the color is a state change too
+        }
+        ++calls;
+        i = end;
+    }
+    Profiler::count(Profiler::DRAW_COMMANDS, batch.size());
+    Profiler::count(Profiler::DRAW_CALLS, calls);
+    callCount += calls;
+    batch.clear();
+}
+
+void RenderBatch::report(ostream& out){
+    out << "Rendering: " << commandCount << " draw commands in " << callCount << " SDL calls" << endl;
+    RetainedImage::report(out);
+}
+
+/*************************************************************************/
+vector<RetainedImage*> RetainedImage::images;
+size_t RetainedImage::bytes = 0, RetainedImage::maxBytes = 32*1024*1024;
+unsigned long RetainedImage::frame = 0, RetainedImage::renders = 0, RetainedImage::reuses = 0;
+
+RetainedImage::RetainedImage(){
+    images.push_back(this);
+}
+
+RetainedImage::~RetainedImage(){
+    release();
+    images.erase(find(images.begin(), images.end(), this));
+}
+
+void RetainedImage::release(){
+    if(!texture){ return; }
+    SDL_DestroyTexture(texture);
+    texture = nullptr;
+    bytes -= size_t(width)*height*4;
+    stale = true;
+}
+
+void RetainedImage::setLimit(size_t limitBytes){
+    maxBytes = limitBytes;
+    while(bytes > maxBytes){ // free the least recently drawn images
+        RetainedImage* oldest = nullptr;
+        for(auto img: images){
+            if(img->texture && (!oldest || img->lastUsed < oldest->lastUsed)){ oldest = img; }
+        }
+        if(!oldest){ break; }
+        oldest->release();
+    }
+}
+
+bool RetainedImage::draw(SDL_Renderer* rend, Object& obj){
+    if(rendering){ return false; } // obj is drawing into the texture right now
+    if(stale || !texture || width != obj.loc.w || height != obj.loc.h){
+        if(!render(rend, obj)){ return false; }
+        ++renders;
+    } else {
+        ++reuses;
+    }
+    lastUsed = ++frame;
+    RenderBatch::image(texture, obj.loc);
+    return true;
+}
+
+// draws obj into the texture.  Returns false if there is no memory left for it
+bool RetainedImage::render(SDL_Renderer* rend, Object& obj){
+    PROFILE("RetainedImage::render");
+    size_t size = size_t(obj.loc.w)*obj.loc.h*4;
+    if(obj.loc.w <= 0 || obj.loc.h <= 0 || size > maxBytes){ return false; }
+    RenderBatch::flush(rend); // draws into the current target.  Textures in the batch can be freed after this
+    if(texture && (width != obj.loc.w || height != obj.loc.h)){ release(); }
+    if(!texture){
+        while(bytes + size > maxBytes){ // free the least recently drawn images.  Not the ones being rendered
+            RetainedImage* oldest = nullptr;
+            for(auto img: images){
+                if(img->texture && !img->rendering && (!oldest || img->lastUsed < oldest->lastUsed)){ oldest = img; }
+            }
+            if(!oldest){ return false; }
+            oldest->release();
+        }
+        texture = SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, obj.loc.w, obj.loc.h);
+        if(!texture){
+            LOG_ERROR("can not create retained image: " << SDL_GetError());
+            return false;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE); // replaces the background like drawing the objects did
+        width = obj.loc.w;
+        height = obj.loc.h;
+        bytes += size;
+    }
+
+    SDL_Texture* oldTarget = SDL_GetRenderTarget(rend);
+    SDL_Rect oldClip;
+    bool clipped = SDL_RenderIsClipEnabled(rend);
+    if(clipped){ SDL_RenderGetClipRect(rend, &oldClip); }
+    int oldX = RenderBatch::originX, oldY = RenderBatch::originY;
+
+    SDL_SetRenderTarget(rend, texture);
+    SDL_RenderSetClipRect(rend, NULL); // the whole object is drawn
+    SDL_SetRenderDrawColor(rend, 0, 0, 0, SDL_ALPHA_OPAQUE); // same background as the canvas
+    SDL_RenderClear(rend);
+    Profiler::count(Profiler::DRAW_CALLS);
+    Profiler::count(Profiler::DRAW_COMMANDS);
+    RenderBatch::setOrigin(obj.loc.x, obj.loc.y);
+    rendering = true;
+    obj.draw(rend);
+    rendering = false;
+    RenderBatch::flush(rend);
+
+    RenderBatch::setOrigin(oldX, oldY);
+    SDL_SetRenderTarget(rend, oldTarget);
+    SDL_RenderSetClipRect(rend, clipped ? &oldClip : NULL);
+    stale = false;
+    return true;
+}
+
+void RetainedImage::report(ostream& out){
+    out << "Retained images: " << images.size() << " using " << bytes/1024 << "KB of " << maxBytes/1024 << "KB. "
+        << renders << " renders, " << reuses << " reused" << endl;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <iostream>
+#include <vector>
+
+struct Object;
+
+// Collects draw commands during the traversal of the tree and sends them to SDL in batches.
+// Commands are drawn layer by layer.  Within a layer they are sorted by texture and color so that
+// images sharing a texture become one SDL_RenderGeometry() call and rectangles of the same color
+// become one SDL_RenderFillRects() or SDL_RenderDrawRects() call.
+// Objects within a layer must not overlap or the order they are drawn in would matter.
+// Textures have to stay alive until flush().  Clip rectangles have to be changed through setClip().
+// Rectangles are in screen coordinates.  setOrigin() moves them when drawing into a RetainedImage.
+class RenderBatch {
+public:
+    enum Layer {IMAGES, OVERLAYS, FILLS, TEXT, OUTLINES, HIGHLIGHTS}; // drawn in this order
+    static void image(SDL_Texture* texture, const SDL_Rect& rect, Layer layer = IMAGES);
+    static void fill(const SDL_Rect& rect, const SDL_Color& color);
+    static void outline(const SDL_Rect& rect, const SDL_Color& color, Layer layer = OUTLINES);
+    static void outline(const SDL_Rect& rect, bool draggedOver); // white frame or red highlight on top of frames
+    static void setClip(SDL_Renderer* rend, const SDL_Rect* clip); // flushes commands drawn with the old clip
+    static bool getClip(SDL_Renderer* rend, SDL_Rect& clip); // returns false if drawing is not clipped
+    static void setOrigin(int x, int y){ originX = x; originY = y; } // screen point that is drawn at 0,0 of the target
+    static void flush(SDL_Renderer* rend); // draws all commands
+    static unsigned long commands(){ return commandCount; } // submitted since start.  Each one used to be a draw call
+    static unsigned long calls(){ return callCount; } // SDL calls made by flush()
+    static void report(std::ostream& out);
+private:
+    friend class RetainedImage;
+    static unsigned long commandCount, callCount;
+    static int originX, originY;
+};
+
+// Image of an object and its children kept in a target texture.  The object is drawn into it only after
+// something inside changed.  Otherwise one image is drawn instead of the whole subtree.
+// Object::invalidate() marks the images of an object and its containers stale.  Moving does not.
+// Textures of all retained images together use at most limit() bytes.  Least recently drawn ones are freed first.
+class RetainedImage {
+    SDL_Texture* texture = nullptr;
+    int width = 0, height = 0;
+    bool rendering = false; // the object is being drawn into the texture
+    unsigned long lastUsed = 0;
+    bool render(SDL_Renderer* rend, Object& obj);
+    void release();
+    static std::vector<RetainedImage*> images; // all of them
+    static size_t bytes, maxBytes;
+    static unsigned long frame, renders, reuses;
+public:
+    bool stale = true;
+    RetainedImage();
+    ~RetainedImage();
+    bool draw(SDL_Renderer* rend, Object& obj); // returns false if obj has to draw itself
+    static void setLimit(size_t limitBytes);
+    static size_t limit(){ return maxBytes; }
+    static size_t memory(){ return bytes; }
+    static void report(std::ostream& out);
+};
+
+const SDL_Color OUTLINE_COLOR = { 255, 255, 255, SDL_ALPHA_OPAQUE };
+const SDL_Color DRAGGED_OVER_COLOR = { 255, 0, 0, SDL_ALPHA_OPAQUE }; // outline of an object something is dragged over
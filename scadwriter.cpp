@@ -0,0 +1,153 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include "scadwriter.h"
+#include "profile.h"
+#include "log.h"
+using namespace std;
+typedef chrono::steady_clock Clock;
+const auto DEBOUNCE = chrono::milliseconds(100); // write after updates stop coming for this long...
+const auto MAX_DELAY = chrono::milliseconds(500); // ...but do not wait longer than this after the first one
+
+
+static string outFile;
+static thread writer;
+static mutex mtx; // protects everything below
+static condition_variable cv;
+static bool stopping = false;
+static bool pending = false;
+static vector<ScadWriter::File> pendingFiles;
+static Clock::time_point firstPost, lastPost; // of the pending update
+static unsigned long posts = 0, writes = 0, coalesced = 0, unchanged = 0, failures = 0, filesWritten = 0, filesSkipped = 0;
+static double writeSeconds = 0, maxWriteSeconds = 0, latencySeconds = 0; // latency is from post to rename
+static unordered_map<string, size_t> written; // hash of the code in each file.  Only the writer thread uses it
+
+static bool writeFile(const string& fileName, const string& code){
+    PROFILE("ScadWriter::writeFile");
+    string tmpFile = fileName + ".tmp";
+    ofstream file(tmpFile, ios_base::out | ios::trunc);
+    file << code;
+    file.close();
+    if(!file.good()){
+        remove(tmpFile.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    remove(fileName.c_str()); // rename() does not overwrite on windows
+#endif
+    return 0 == rename(tmpFile.c_str(), fileName.c_str());
+}
+
+static void write(){
+    hash<string> hashCode; // files with the same code are skipped
+    unique_lock<mutex> lock(mtx);
+    while(true){
+        cv.wait(lock, []{ return stopping || pending; });
+        while(pending && !stopping){ // wait for updates to settle down
+            auto deadline = min(lastPost + DEBOUNCE, firstPost + MAX_DELAY);
+            if(Clock::now() >= deadline){ break; }
+            cv.wait_until(lock, deadline);
+        }
+        if(!pending){ return; } // stopping
+        vector<ScadWriter::File> files;
+        files.swap(pendingFiles);
+        pending = false;
+        auto posted = firstPost;
+        lock.unlock();
+
+        auto t = Clock::now();
+        int changed = 0, skipped = 0, failed = 0;
+        for(auto& f: files){
+            size_t h = hashCode(f.code);
+            auto it = written.find(f.name);
+            if(it != written.end() && it->second == h){
+                ++skipped;
+                continue;
+            }
+            ++changed;
+            if(!writeFile(f.name, f.code)){ // other files are still written so that they are not left stale
+                LOG_ERROR("can not write " << f.name);
+                written.erase(f.name); // written by the next update even if its code is the same
+                ++failed;
+                continue;
+            }
+            written[f.name] = h;
+        }
+        auto end = Clock::now();
+
+        lock.lock();
+        filesWritten += changed - failed;
+        filesSkipped += skipped;
+        if(!changed){
+            ++unchanged;
+            continue;
+        }
+        if(failed){
+            ++failures;
+            continue;
+        }
+        double seconds = chrono::duration<double>(end - t).count();
+        ++writes;
+        writeSeconds += seconds;
+        maxWriteSeconds = max(maxWriteSeconds, seconds);
+        latencySeconds += chrono::duration<double>(end - posted).count();
+    }
+}
+
+void ScadWriter::start(const string& fileName){
+    outFile = fileName;
+    stopping = false;
+    writer = thread(write);
+}
+
+void ScadWriter::stop(){
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if(writer.joinable()){ writer.join(); }
+}
+
+string ScadWriter::fileName(){
+    return outFile;
+}
+
+void ScadWriter::post(string code){
+    vector<File> files(1);
+    files[0].name = outFile;
+    files[0].code.swap(code);
+    post(move(files));
+}
+
+void ScadWriter::post(vector<File> files){
+    {
+        lock_guard<mutex> lock(mtx);
+        lastPost = Clock::now();
+        if(pending){
+            ++coalesced; // previous update will never be written
+        } else {
+            firstPost = lastPost;
+        }
+        pendingFiles.swap(files);
+        pending = true;
+        ++posts;
+    }
+    cv.notify_all();
+}
+
+void ScadWriter::report(ostream& out){
+    lock_guard<mutex> lock(mtx);
+    out << outFile << " updates: " << posts << " written: " << writes << " coalesced: " << coalesced
+        << " unchanged: " << unchanged << " failed: " << failures << " files written: " << filesWritten << " skipped: " << filesSkipped;
+    if(writes){
+        out << " write ms avg: " << 1000*writeSeconds/writes << " max: " << 1000*maxWriteSeconds
+            << " update-to-disk ms avg: " << 1000*latencySeconds/writes;
+    }
+    out << endl;
+}
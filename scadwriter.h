@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Writes openscad code into a file on a background thread so that the UI never waits for the disk.
+// Updates posted in quick succession (for example while scrolling an Input) are coalesced and only the
+// latest one is written.  The code is written into a temporary file first and then renamed over the
+// output file so that openscad's auto-reload never sees a half written file.
+// An update can consist of several files.  Files whose code did not change since they were written are skipped.
+// this class has to be initialized by calling ScadWriter::start()
+class ScadWriter {
+public:
+    struct File {
+        std::string name;
+        std::string code;
+    };
+    static void start(const std::string& fileName);
+    static void stop(); // writes the last update and waits for the thread to exit
+    static std::string fileName(); // given to start()
+    static void post(std::string code); // replaces the update waiting to be written
+    static void post(std::vector<File> files); // same for several files.  They are written in this order
+    static void report(std::ostream& out); // print number of writes, coalesced updates and latency
+};
@@ -3,18 +3,100 @@
 
 #include <SDL2/SDL_ttf.h>
 #include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
 #include <iostream>
 
 
 constexpr SDL_Color WHITE = { 255, 255, 255, SDL_ALPHA_OPAQUE };
 
 // A class for printing text on the screen
-// TODO: a method for returning a texture with text printed
+// Each glyph is rasterized once into a shared atlas texture.  Strings are drawn as a batch of textured quads.
 class Text {
     TTF_Font * font = nullptr;
     const int height;
+
+    static const int ATLAS_SIZE = 512;
+    static const int FIRST_CHAR = 32; // only printable ASCII is cached in the atlas
+    static const int LAST_CHAR = 126;
+    struct Glyph {
+        bool cached = false;
+        SDL_Rect src;  // location of the glyph in the atlas
+        int advance;   // how far to move the pen after drawing this glyph
+    };
+    Glyph glyphs[LAST_CHAR-FIRST_CHAR+1];
+    SDL_Renderer* atlasRenderer = nullptr; // atlas belongs to this renderer
+    std::shared_ptr<SDL_Texture> atlas;
+    int penX = 0, penY = 0, shelfHeight = 0; // next free spot in the atlas
+    unsigned long hits = 0, misses = 0;
+    std::vector<SDL_Vertex> vertices; // reused between calls to print()
+    std::vector<int> indices;
+
+    bool createAtlas(SDL_Renderer* renderer){
+        SDL_Texture* t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, ATLAS_SIZE, ATLAS_SIZE);
+        if(!t){ return false; }
+        SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+        atlas = std::shared_ptr<SDL_Texture>(t, &SDL_DestroyTexture);
+        atlasRenderer = renderer;
+        penX = penY = shelfHeight = 0;
+        for(auto& g: glyphs){ g.cached = false; }
+        return true;
+    }
+
+    // rasterize a glyph in white (color is applied per vertex) and copy it into the atlas
+    bool cacheGlyph(char c, Glyph& g){
+        if( TTF_GlyphMetrics(font, c, NULL, NULL, NULL, NULL, &g.advance) ){ return false; }
+        SDL_Surface* surface = TTF_RenderGlyph_Blended(font, c, WHITE);
+        if(!surface){ return false; }
+        SDL_Surface* argb = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+        if(!argb){ return false; }
+        if(penX + argb->w > ATLAS_SIZE){ // start a new shelf
+            penX = 0;
+            penY += shelfHeight;
+            shelfHeight = 0;
+        }
+        if(penY + argb->h > ATLAS_SIZE){ // atlas is full
+            SDL_FreeSurface(argb);
+            return false;
+        }
+        g.src = { penX, penY, argb->w, argb->h };
+        SDL_UpdateTexture(atlas.get(), &g.src, argb->pixels, argb->pitch);
+        penX += argb->w;
+        shelfHeight = std::max(shelfHeight, argb->h);
+        SDL_FreeSurface(argb);
+        g.cached = true;
+        return true;
+    }
+
+    const Glyph* getGlyph(char c){
+        if(c < FIRST_CHAR || c > LAST_CHAR){ c = '?'; }
+        Glyph& g = glyphs[c-FIRST_CHAR];
+        if(g.cached){
+            ++hits;
+            return &g;
+        }
+        ++misses;
+        return cacheGlyph(c, g) ? &g : nullptr;
+    }
+
+    void addQuad(const SDL_Rect& dst, const SDL_Rect& src, const SDL_Color& color){
+        const float s = 1.0f/ATLAS_SIZE;
+        int first = vertices.size();
+        float x0 = dst.x, y0 = dst.y, x1 = dst.x+dst.w, y1 = dst.y+dst.h;
+        float u0 = src.x*s, v0 = src.y*s, u1 = (src.x+src.w)*s, v1 = (src.y+src.h)*s;
+        vertices.push_back({ {x0,y0}, color, {u0,v0} });
+        vertices.push_back({ {x1,y0}, color, {u1,v0} });
+        vertices.push_back({ {x1,y1}, color, {u1,v1} });
+        vertices.push_back({ {x0,y1}, color, {u0,v1} });
+        int quad[] = { first, first+1, first+2, first, first+2, first+3 };
+        indices.insert(indices.end(), std::begin(quad), std::end(quad));
+    }
 public:
     int getHeightPixels(){ return height; }
+    unsigned long getAtlasHits() const { return hits; }
+    unsigned long getAtlasMisses() const { return misses; }
 
     // https://www.w3.org/TR/css3-values/#absolute-lengths
     // There are 96 pixels per inch and 72 points per inch
@@ -37,18 +119,33 @@ public:
 // There is a need for an error logging service to report errors
     int print(const std::string& text, int x, int y, SDL_Renderer* renderer, const SDL_Color& color = WHITE){
         if(!font) { return -1001; } // font did not load successfuly.  Is the ttf file there?
-        SDL_Surface * surface = TTF_RenderText_Solid(font, text.c_str(), color);
-        if(!surface) { return -1002; } // use large numbers to differentiate from SDL errors
-        SDL_Texture * texture = SDL_CreateTextureFromSurface(renderer, surface);
-        if(!texture){
-            SDL_FreeSurface(surface);
-            return -1003;
+        if(atlasRenderer != renderer && !createAtlas(renderer)){ return -1003; }
+        vertices.clear();
+        indices.clear();
+        int pen = x;
+        for(char c: text){
+            const Glyph* g = getGlyph(c);
+            if(!g){ return -1002; } // use large numbers to differentiate from SDL errors
+            addQuad({ pen, y, g->src.w, g->src.h }, g->src, color);
+            pen += g->advance;
         }
-        SDL_Rect rect = { x, y, surface->w, surface->h }; // now we know width and height
-        int err = SDL_RenderCopy(renderer, texture, NULL, &rect);
-        SDL_DestroyTexture(texture);
+        if(indices.empty()){ return 0; }
+        int err = SDL_RenderGeometry(renderer, atlas.get(), vertices.data(), vertices.size(), indices.data(), indices.size());
+        return err ? err : pen-x; // return width of the text which depends on the length of the text
+    }
+
+// returns a texture with the text printed on it or an empty pointer on error
+// Use it for text that does not change often.  w and h are set to the size of the texture.
+    std::shared_ptr<SDL_Texture> render(const std::string& text, SDL_Renderer* renderer, int& w, int& h, const SDL_Color& color = WHITE){
+        if(!font || text.empty()) { return nullptr; }
+        SDL_Surface * surface = TTF_RenderText_Blended(font, text.c_str(), color);
+        if(!surface) { return nullptr; }
+        SDL_Texture * texture = SDL_CreateTextureFromSurface(renderer, surface);
+        w = surface->w;
+        h = surface->h;
         SDL_FreeSurface(surface);
-        return err ? err : rect.w; // return width of the texture which depends on the length of the text
+        if(!texture){ return nullptr; }
+        return std::shared_ptr<SDL_Texture>(texture, &SDL_DestroyTexture);
     }
 };
 
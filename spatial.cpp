@@ -0,0 +1,135 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include "spatial.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_KERNELS
+#include <immintrin.h>
+#endif
+using namespace std;
+
+// Each kernel appends indexes i in [first,end) of matching rectangles to out.
+// A point hits if !(left > x || x > right || top > y || y > bottom).
+// A rectangle (x0,y0)-(x1,y1) overlaps if x1 > left && right > x0 && y1 > top && bottom > y0 && right > left && bottom > top.
+typedef void (*PointKernel)(const int* l, const int* t, const int* r, const int* b, int first, int end, int x, int y, vector<int>& out);
+typedef void (*OverlapKernel)(const int* l, const int* t, const int* r, const int* b, int first, int end, const int box[4], vector<int>& out);
+
+static void pointScalar(const int* l, const int* t, const int* r, const int* b, int first, int end, int x, int y, vector<int>& out){
+    for(int i = first; i < end; ++i){
+        if(l[i] <= x && x <= r[i] && t[i] <= y && y <= b[i]){ out.push_back(i); }
+    }
+}
+
+static void overlapScalar(const int* l, const int* t, const int* r, const int* b, int first, int end, const int box[4], vector<int>& out){
+    for(int i = first; i < end; ++i){
+        if(box[2] > l[i] && r[i] > box[0] && box[3] > t[i] && b[i] > box[1] && r[i] > l[i] && b[i] > t[i]){ out.push_back(i); }
+    }
+}
+
+static inline void pushBits(unsigned mask, int i, vector<int>& out){
+    while(mask){
+        out.push_back(i + __builtin_ctz(mask));
+        mask &= mask-1;
+    }
+}
+
+#ifdef SIMD_KERNELS
+__attribute__((target("sse2")))
+static void pointSse2(const int* l, const int* t, const int* r, const int* b, int first, int end, int x, int y, vector<int>& out){
+    const __m128i X = _mm_set1_epi32(x), Y = _mm_set1_epi32(y);
+    int i = first;
+    for(; i+4 <= end; i += 4){
+        __m128i miss = _mm_or_si128(
+            _mm_or_si128( _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(l+i)), X), _mm_cmpgt_epi32(X, _mm_loadu_si128((const __m128i*)(r+i))) ),
+            _mm_or_si128( _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(t+i)), Y), _mm_cmpgt_epi32(Y, _mm_loadu_si128((const __m128i*)(b+i))) ));
+        pushBits(~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xF, i, out);
+    }
+    pointScalar(l, t, r, b, i, end, x, y, out);
+}
+
+__attribute__((target("sse2")))
+static void overlapSse2(const int* l, const int* t, const int* r, const int* b, int first, int end, const int box[4], vector<int>& out){
+    const __m128i X0 = _mm_set1_epi32(box[0]), Y0 = _mm_set1_epi32(box[1]), X1 = _mm_set1_epi32(box[2]), Y1 = _mm_set1_epi32(box[3]);
+    int i = first;
+    for(; i+4 <= end; i += 4){
+        __m128i L = _mm_loadu_si128((const __m128i*)(l+i)), T = _mm_loadu_si128((const __m128i*)(t+i));
+        __m128i R = _mm_loadu_si128((const __m128i*)(r+i)), B = _mm_loadu_si128((const __m128i*)(b+i));
+        __m128i hit = _mm_and_si128(
+            _mm_and_si128( _mm_and_si128(_mm_cmpgt_epi32(X1, L), _mm_cmpgt_epi32(R, X0)), _mm_and_si128(_mm_cmpgt_epi32(Y1, T), _mm_cmpgt_epi32(B, Y0)) ),
+            _mm_and_si128(_mm_cmpgt_epi32(R, L), _mm_cmpgt_epi32(B, T)) );
+        pushBits(_mm_movemask_ps(_mm_castsi128_ps(hit)), i, out);
+    }
+    overlapScalar(l, t, r, b, i, end, box, out);
+}
+
+__attribute__((target("avx2")))
+static void pointAvx2(const int* l, const int* t, const int* r, const int* b, int first, int end, int x, int y, vector<int>& out){
+    const __m256i X = _mm256_set1_epi32(x), Y = _mm256_set1_epi32(y);
+    int i = first;
+    for(; i+8 <= end; i += 8){
+        __m256i miss = _mm256_or_si256(
+            _mm256_or_si256( _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(l+i)), X), _mm256_cmpgt_epi32(X, _mm256_loadu_si256((const __m256i*)(r+i))) ),
+            _mm256_or_si256( _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(t+i)), Y), _mm256_cmpgt_epi32(Y, _mm256_loadu_si256((const __m256i*)(b+i))) ));
+        pushBits(~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xFF, i, out);
+    }
+    pointScalar(l, t, r, b, i, end, x, y, out);
+}
+
+__attribute__((target("avx2")))
+static void overlapAvx2(const int* l, const int* t, const int* r, const int* b, int first, int end, const int box[4], vector<int>& out){
+    const __m256i X0 = _mm256_set1_epi32(box[0]), Y0 = _mm256_set1_epi32(box[1]), X1 = _mm256_set1_epi32(box[2]), Y1 = _mm256_set1_epi32(box[3]);
+    int i = first;
+    for(; i+8 <= end; i += 8){
+        __m256i L = _mm256_loadu_si256((const __m256i*)(l+i)), T = _mm256_loadu_si256((const __m256i*)(t+i));
+        __m256i R = _mm256_loadu_si256((const __m256i*)(r+i)), B = _mm256_loadu_si256((const __m256i*)(b+i));
+        __m256i hit = _mm256_and_si256(
+            _mm256_and_si256( _mm256_and_si256(_mm256_cmpgt_epi32(X1, L), _mm256_cmpgt_epi32(R, X0)), _mm256_and_si256(_mm256_cmpgt_epi32(Y1, T), _mm256_cmpgt_epi32(B, Y0)) ),
+            _mm256_and_si256(_mm256_cmpgt_epi32(R, L), _mm256_cmpgt_epi32(B, T)) );
+        pushBits(_mm256_movemask_ps(_mm256_castsi256_ps(hit)), i, out);
+    }
+    overlapScalar(l, t, r, b, i, end, box, out);
+}
+#endif
+
+struct Kernels {
+    string name;
+    PointKernel point;
+    OverlapKernel overlap;
+};
+
+static bool findKernel(const string& name, Kernels& k){ // false if the CPU can not run it
+#ifdef SIMD_KERNELS
+    if("avx2" == name && SDL_HasAVX2()){ k = {name, pointAvx2, overlapAvx2}; return true; }
+    if("sse2" == name && SDL_HasSSE2()){ k = {name, pointSse2, overlapSse2}; return true; }
+#endif
+    if("scalar" == name){ k = {name, pointScalar, overlapScalar}; return true; }
+    return false;
+}
+
+static Kernels& kernels(){
+    static Kernels k;
+    static bool picked = findKernel("avx2", k) || findKernel("sse2", k) || findKernel("scalar", k); // fastest first
+    (void)picked;
+    return k;
+}
+
+bool RectArray::useKernel(const string& name){
+    return findKernel(name, kernels());
+}
+
+string RectArray::kernel(){
+    return kernels().name;
+}
+
+void RectArray::query(const Point& xy, int first, int end, vector<int>& out) const {
+    out.clear();
+    end = min(end, size());
+    if(first >= end){ return; }
+    kernels().point(left.data(), top.data(), right.data(), bottom.data(), first, end, xy.x, xy.y, out);
+}
+
+void RectArray::overlapping(const SDL_Rect& r, int first, int end, vector<int>& out) const {
+    out.clear();
+    end = min(end, size());
+    if(first >= end || r.w <= 0 || r.h <= 0){ return; } // empty rectangles do not overlap anything
+    const int box[4] = {r.x, r.y, r.x+r.w, r.y+r.h};
+    kernels().overlap(left.data(), top.data(), right.data(), bottom.data(), first, end, box, out);
+}
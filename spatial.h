@@ -0,0 +1,95 @@
+#pragma once
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <vector>
+#include <algorithm>
+#include <string>
+#include "misc.h"
+
+// Uniform grid over a list of rectangles for fast point queries.
+// Rectangles are kept in the grid by their index.  Queries return indexes in increasing order,
+// so the first one returned is the same rectangle a linear scan with Point::inRectangle() would find.
+class SpatialGrid {
+    std::vector<SDL_Rect> rects;
+    std::vector<int> cellStart; // items of cell i are items[cellStart[i]] ... items[cellStart[i+1]-1]
+    std::vector<int> items;
+    SDL_Rect bounds = {0,0,0,0};
+    int cellW = 1, cellH = 1, cols = 0, rows = 0;
+    static const int MAX_CELLS = 256; // in each direction
+
+    int col(int x) const { return std::min(cols-1, std::max(0, (x-bounds.x)/cellW)); }
+    int row(int y) const { return std::min(rows-1, std::max(0, (y-bounds.y)/cellH)); }
+
+    template<class F> void forCells(const SDL_Rect& r, F f) const { // Point::inRectangle() includes right & bottom edges
+        for(int y = row(r.y); y <= row(r.y+r.h); ++y){
+            for(int x = col(r.x); x <= col(r.x+r.w); ++x){ f(y*cols+x); }
+        }
+    }
+public:
+    int size() const { return rects.size(); }
+
+    void build(const std::vector<SDL_Rect>& rectangles){
+        rects = rectangles;
+        items.clear();
+        cellStart.assign(1, 0);
+        cols = rows = 0;
+        if(rects.empty()){ return; }
+        bounds = rects[0];
+        long long w = 0, h = 0;
+        for(auto& r: rects){
+            SDL_UnionRect(&bounds, &r, &bounds);
+            w += r.w;
+            h += r.h;
+        }
+        cellW = std::max<long long>( std::max(1, bounds.w/MAX_CELLS), w/rects.size() ); // average rectangle size
+        cellH = std::max<long long>( std::max(1, bounds.h/MAX_CELLS), h/rects.size() );
+        cols = bounds.w/cellW + 1;
+        rows = bounds.h/cellH + 1;
+
+        cellStart.assign(cols*rows+1, 0); // count items in each cell then place them
+        for(auto& r: rects){ forCells(r, [&](int c){ ++cellStart[c+1]; }); }
+        for(int c = 0; c < cols*rows; ++c){ cellStart[c+1] += cellStart[c]; }
+        items.resize(cellStart.back());
+        std::vector<int> next(cellStart.begin(), cellStart.end()-1);
+        for(int i = 0; i < (int)rects.size(); ++i){ // items in each cell end up sorted by index
+            forCells(rects[i], [&](int c){ items[next[c]++] = i; });
+        }
+    }
+
+    // indexes of all rectangles containing xy in increasing order.  Returns the number of rectangles tested
+    int query(const Point& xy, std::vector<int>& out) const {
+        out.clear();
+        if(rects.empty() || !xy.inRectangle(bounds)){ return 0; }
+        int c = row(xy.y)*cols + col(xy.x);
+        for(int i = cellStart[c]; i < cellStart[c+1]; ++i){
+            if(xy.inRectangle(rects[items[i]])){ out.push_back(items[i]); }
+        }
+        return cellStart[c+1] - cellStart[c];
+    }
+
+    int find(const Point& xy) const { // index of the first rectangle containing xy or -1
+        if(rects.empty() || !xy.inRectangle(bounds)){ return -1; }
+        int c = row(xy.y)*cols + col(xy.x);
+        for(int i = cellStart[c]; i < cellStart[c+1]; ++i){
+            if(xy.inRectangle(rects[items[i]])){ return items[i]; }
+        }
+        return -1;
+    }
+};
+
+
+// Rectangles stored as separate arrays of left, top, right and bottom edges.
+// Queries test 8 or 4 rectangles at a time with AVX2 or SSE2 when the CPU has them.
+// Like SpatialGrid, queries return indexes in increasing order.
+class RectArray {
+    std::vector<int> left, top, right, bottom; // right = x+w, bottom = y+h
+public:
+    int size() const { return left.size(); }
+    void resize(int n){ left.resize(n); top.resize(n); right.resize(n); bottom.resize(n); }
+    void set(int i, const SDL_Rect& r){ left[i] = r.x; top[i] = r.y; right[i] = r.x+r.w; bottom[i] = r.y+r.h; }
+    // indexes of rectangles in [first,end) containing xy.  Edges are included like in Point::inRectangle()
+    void query(const Point& xy, int first, int end, std::vector<int>& out) const;
+    // indexes of rectangles in [first,end) overlapping r.  Same test as SDL_HasIntersection()
+    void overlapping(const SDL_Rect& r, int first, int end, std::vector<int>& out) const;
+    static bool useKernel(const std::string& name); // "avx2", "sse2" or "scalar".  False if the CPU can not run it
+    static std::string kernel(); // kernel in use.  The fastest one is picked at startup
+};
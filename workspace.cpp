@@ -0,0 +1,303 @@
+#include <SDL2/SDL.h> // Simple Directmedia Layer lib has to be installed
+#include <SDL2/SDL_image.h> // for loading PNG images
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+#include "workspace.h"
+#include "object.h"
+#include "preview.h"
+#include "log.h"
+using namespace std;
+const char MAGIC[8] = "ASMCADW";
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+std::shared_ptr<Main> Workspace::main;
+std::shared_ptr<Labels> Workspace::labels;
+
+
+static uint64_t align8(uint64_t offset){ return (offset + 7) & ~7ULL; }
+
+// collects nodes in the order they will be saved
+struct NodeTable {
+    vector<WorkspaceNode> nodes;
+    vector<shared_ptr<Object>> objects; // object of each node
+    vector<uint32_t> children;
+    unordered_map<Object*, uint32_t> index; // an object added twice gets one node
+
+    // adds obj and returns its index.  Returns -1 if objects of this kind are not saved
+    long add(shared_ptr<Object> const & obj){
+        auto it = index.find(obj.get());
+        if(it != index.end()){ return it->second; }
+        WorkspaceNode node;
+        memset(&node, 0, sizeof(node));
+        auto op = dynamic_pointer_cast<Operator>(obj);
+        auto mod = dynamic_pointer_cast<Module>(obj);
+        auto xyz = dynamic_pointer_cast<XYZ>(obj);
+        if(op){
+            node.kind = WorkspaceNode::OPERATOR;
+            node.type = op->type;
+            node.moduleId = op->getModuleId();
+        } else if(mod){
+            auto modOp = mod->getOperator();
+            if(!modOp || !modOp->getModuleId() || add(modOp) < 0){ return -1; } // operator is saved even if it is not in Main
+            node.kind = WorkspaceNode::MODULE;
+            node.moduleId = modOp->getModuleId();
+        } else if(xyz){
+            auto shape = dynamic_pointer_cast<Shape>(obj);
+            auto modifier = dynamic_pointer_cast<Modifier>(obj);
+            if(!shape && !modifier){ return -1; }
+            node.kind = shape ? WorkspaceNode::SHAPE : WorkspaceNode::MODIFIER;
+            node.type = shape ? (int)shape->type : (int)modifier->type;
+            for(int i = 0; i < 3; ++i){
+                node.values[i] = xyz->getInput(i).getValue();
+                node.deltas[i] = xyz->getInput(i).getDelta();
+            }
+        } else {
+            return -1;
+        }
+        index[obj.get()] = nodes.size();
+        nodes.push_back(node);
+        objects.push_back(obj);
+        return nodes.size()-1;
+    }
+
+    // adds objs and their indexes to children.  Returns the first index in children
+    uint32_t addChildren(const vector<shared_ptr<Object>>& objs){
+        vector<uint32_t> range;
+        for(auto& o: objs){
+            long i = add(o);
+            if(i >= 0){ range.push_back(i); }
+        }
+        uint32_t first = children.size();
+        children.insert(children.end(), range.begin(), range.end());
+        return first;
+    }
+};
+
+static string readFile(const string& fileName){
+    ifstream file(fileName, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+bool Workspace::save(const string& fileName){
+    NodeTable table;
+    WorkspaceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.mainFirst = table.addChildren(main->getChildren());
+    header.mainCount = table.children.size() - header.mainFirst;
+    header.labelsFirst = table.addChildren(labels->getChildren());
+    header.labelsCount = table.children.size() - header.labelsFirst;
+    vector<string> images(1); // PNG files of module images.  images[0] is no image
+    for(size_t i = 0; i < table.objects.size(); ++i){ // table grows while children are added
+        auto op = dynamic_pointer_cast<Operator>(table.objects[i]);
+        if(!op){ continue; }
+        uint32_t first = table.addChildren(op->getChildren());
+        table.nodes[i].firstChild = first;
+        table.nodes[i].childCount = table.children.size() - first;
+        if(op->getModuleId()){ // images rendered by openscad are in ThumbnailCache
+            string key = ScadSaver::imageKey(op);
+            string png = key.empty() ? string() : readFile(ThumbnailCache::path(key));
+            if(!png.empty()){
+                table.nodes[i].imgSize = png.size(); // imgOffset is set below
+                table.nodes[i].imgOffset = images.size();
+                images.push_back(png);
+            }
+        }
+    }
+
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.nodeSize = sizeof(WorkspaceNode);
+    header.nodeCount = table.nodes.size();
+    header.childCount = table.children.size();
+    header.nodesOffset = align8(sizeof(header));
+    header.childrenOffset = header.nodesOffset + sizeof(WorkspaceNode)*table.nodes.size();
+    uint64_t childrenEnd = header.childrenOffset + sizeof(uint32_t)*table.children.size();
+    uint64_t offset = align8(childrenEnd);
+    vector<uint64_t> imageOffsets(images.size());
+    for(size_t i = 1; i < images.size(); ++i){
+        imageOffsets[i] = offset;
+        offset += images[i].size();
+    }
+    header.fileSize = offset;
+    for(auto& node: table.nodes){
+        if(node.imgSize){ node.imgOffset = imageOffsets[node.imgOffset]; }
+    }
+
+    string tmpFile = fileName + ".tmp"; // a crash while saving should not destroy the last saved workspace
+    ofstream file(tmpFile, ios::binary | ios::trunc);
+    const char zeros[8] = {0};
+    file.write((const char*)&header, sizeof(header));
+    file.write(zeros, header.nodesOffset - sizeof(header));
+    file.write((const char*)table.nodes.data(), sizeof(WorkspaceNode)*table.nodes.size());
+    file.write((const char*)table.children.data(), sizeof(uint32_t)*table.children.size());
+    file.write(zeros, align8(childrenEnd) - childrenEnd);
+    for(size_t i = 1; i < images.size(); ++i){
+        file.write(images[i].data(), images[i].size());
+    }
+    file.close();
+    if(!file.good()){
+        remove(tmpFile.c_str());
+        LOG_ERROR("can not write " << fileName);
+        return false;
+    }
+#ifdef _WIN32
+    remove(fileName.c_str()); // rename() does not overwrite on windows
+#endif
+    if(0 != rename(tmpFile.c_str(), fileName.c_str())){
+        LOG_ERROR("can not write " << fileName);
+        return false;
+    }
+    LOG_INFO("Saved " << table.nodes.size() << " objects and " << images.size()-1 << " images to " << fileName);
+    return true;
+}
+
+
+// checks that everything in the file is where the header and nodes say it is
+static bool valid(const WorkspaceHeader& h, uint64_t size){
+    if(size < sizeof(h) || 0 != memcmp(h.magic, MAGIC, sizeof(h.magic))){ return false; }
+    if(h.version != Workspace::VERSION || h.byteOrder != BYTE_ORDER_MARK || h.nodeSize != sizeof(WorkspaceNode)){ return false; }
+    if(h.fileSize != size || h.nodesOffset % 8 || h.childrenOffset % 4){ return false; }
+    if(h.nodesOffset + (uint64_t)h.nodeCount*sizeof(WorkspaceNode) > size){ return false; }
+    if(h.childrenOffset + (uint64_t)h.childCount*sizeof(uint32_t) > size){ return false; }
+    if((uint64_t)h.mainFirst + h.mainCount > h.childCount || (uint64_t)h.labelsFirst + h.labelsCount > h.childCount){ return false; }
+    const WorkspaceNode* nodes = (const WorkspaceNode*)((const char*)&h + h.nodesOffset);
+    const uint32_t* children = (const uint32_t*)((const char*)&h + h.childrenOffset);
+    for(uint32_t i = 0; i < h.childCount; ++i){
+        if(children[i] >= h.nodeCount){ return false; }
+    }
+    for(uint32_t i = 0; i < h.nodeCount; ++i){
+        const WorkspaceNode& n = nodes[i];
+        if(n.kind > WorkspaceNode::MODIFIER || n.type > 2 || n.moduleId < 0){ return false; }
+        if((uint64_t)n.firstChild + n.childCount > h.childCount){ return false; }
+        if(n.imgSize && (n.imgOffset > size || n.imgSize > size - n.imgOffset || n.imgSize > 0x7fffffff)){ return false; }
+    }
+    return true;
+}
+
+// every node is used at most once and an Operator does not contain itself.  Otherwise objects would be
+// shared by two containers or layout and saving would never end.  Checked before objects are made
+static bool validTree(const WorkspaceHeader& h, const WorkspaceNode* nodes, const uint32_t* children){
+    const uint32_t NONE = 0xffffffff, ROOT = 0xfffffffe; // parents of unused nodes and of children of Main and Labels
+    vector<uint32_t> parent(h.nodeCount, NONE);
+    auto adopt = [&](uint32_t first, uint32_t count, uint32_t p){
+        for(uint32_t c = first; c < first + count; ++c){
+            if(NONE != parent[children[c]]){ return false; } // second container
+            parent[children[c]] = p;
+        }
+        return true;
+    };
+    if(!adopt(h.mainFirst, h.mainCount, ROOT) || !adopt(h.labelsFirst, h.labelsCount, ROOT)){ return false; }
+    for(uint32_t i = 0; i < h.nodeCount; ++i){
+        if(WorkspaceNode::OPERATOR == nodes[i].kind && !adopt(nodes[i].firstChild, nodes[i].childCount, i)){ return false; }
+    }
+    vector<uint8_t> mark(h.nodeCount, 0); // 1 on the current walk, 2 leads to a root or an unused node
+    for(uint32_t i = 0; i < h.nodeCount; ++i){ // with one parent per node, following parents finds every loop
+        uint32_t n = i;
+        for( ; n < h.nodeCount && 0 == mark[n]; n = parent[n]){ mark[n] = 1; }
+        if(n < h.nodeCount && 1 == mark[n]){ return false; } // came back to a node of this walk
+        for(n = i; n < h.nodeCount && 1 == mark[n]; n = parent[n]){ mark[n] = 2; }
+    }
+    return true;
+}
+
+bool Workspace::load(const string& fileName){
+    auto start = chrono::steady_clock::now();
+    MappedFile file;
+    if(!file.open(fileName)){
+        LOG_ERROR("can not open " << fileName);
+        return false;
+    }
+    const WorkspaceHeader& h = *(const WorkspaceHeader*)file.begin; // mmap() returns page aligned memory
+    if(!valid(h, file.end - file.begin)){
+        LOG_ERROR(fileName << " is not an asmcad workspace or it was saved by a different version");
+        return false;
+    }
+    const WorkspaceNode* nodes = (const WorkspaceNode*)(file.begin + h.nodesOffset);
+    const uint32_t* children = (const uint32_t*)(file.begin + h.childrenOffset);
+    if(!validTree(h, nodes, children)){
+        LOG_ERROR(fileName << ": an object is used twice or contains itself");
+        return false;
+    }
+
+    vector<shared_ptr<Object>> objects(h.nodeCount);
+    unordered_map<int, shared_ptr<Operator>> modules; // by module id
+    vector<shared_ptr<Operator>> noImage; // modules whose images have to be made
+    int images = 0;
+    for(uint32_t i = 0; i < h.nodeCount; ++i){
+        const WorkspaceNode& n = nodes[i];
+        if(WorkspaceNode::OPERATOR == n.kind){
+            auto op = makeClone<Operator>( Operator::OperatorType(n.type) );
+            objects[i] = op;
+            if(!n.moduleId){ continue; }
+            if(modules.count(n.moduleId)){
+                LOG_ERROR(fileName << ": module " << n.moduleId << " is saved twice");
+                return false;
+            }
+            modules[n.moduleId] = op;
+            op->setModuleId(n.moduleId);
+            shared_ptr<SDL_Texture> texture;
+            if(n.imgSize && !ImageLoader::isHeadless()){ // module calls get the image when they are made below
+                SDL_Surface* surface = IMG_Load_RW( SDL_RWFromConstMem(file.begin + n.imgOffset, n.imgSize), 1 );
+                texture = ImageLoader::getImage(surface);
+                SDL_FreeSurface(surface);
+            }
+            if(texture){
+                op->setModuleImage(texture);
+                ++images;
+            } else {
+                noImage.push_back(op);
+            }
+        } else if(WorkspaceNode::SHAPE == n.kind || WorkspaceNode::MODIFIER == n.kind){
+            shared_ptr<XYZ> xyz;
+            if(WorkspaceNode::SHAPE == n.kind){
+                xyz = makeClone<Shape>( Shape::ShapeType(n.type) );
+            } else {
+                xyz = makeClone<Modifier>( Modifier::ModifierType(n.type) );
+            }
+            xyz->setValues(n.values[0], n.values[1], n.values[2]);
+            for(int a = 0; a < 3; ++a){ xyz->getInput(a).setDelta(n.deltas[a]); }
+            objects[i] = xyz;
+        }
+    }
+    for(uint32_t i = 0; i < h.nodeCount; ++i){ // modules exist now
+        if(WorkspaceNode::MODULE != nodes[i].kind){ continue; }
+        auto it = modules.find(nodes[i].moduleId);
+        if(it == modules.end()){
+            LOG_ERROR(fileName << ": module " << nodes[i].moduleId << " is not defined");
+            return false;
+        }
+        objects[i] = it->second->getModuleCall();
+    }
+    for(uint32_t i = 0; i < h.nodeCount; ++i){
+        if(WorkspaceNode::OPERATOR != nodes[i].kind){ continue; }
+        auto op = static_pointer_cast<Operator>(objects[i]);
+        for(uint32_t c = nodes[i].firstChild; c < nodes[i].firstChild + nodes[i].childCount; ++c){
+            op->addObject(objects[children[c]]);
+        }
+    }
+    for(uint32_t c = h.mainFirst; c < h.mainFirst + h.mainCount; ++c){
+        main->addObject(objects[children[c]]);
+    }
+    for(uint32_t c = h.labelsFirst; c < h.labelsFirst + h.labelsCount; ++c){
+        labels->addObject(objects[children[c]]);
+    }
+
+    if(!noImage.empty()){ // images are made from the code of the whole tree
+        for(auto& op: noImage){ op->getModule(); }
+        for(uint32_t i = 0; i < h.nodeCount; ++i){
+            if(WorkspaceNode::MODULE == nodes[i].kind){
+                objects[i]->setImage( modules[nodes[i].moduleId]->getModuleCall()->img );
+            }
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    LOG_INFO("Loaded " << h.nodeCount << " objects and " << images << " images from " << fileName << " in " << ms << " ms");
+    return true;
+}
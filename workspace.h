@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+
+struct Main;
+struct Labels;
+
+// Binary file with the whole state of the editor: operators in Main, modules in Labels,
+// values and deltas of Inputs and module images.  It opens much faster than openscad code.
+//
+// Layout (native little endian byte order):
+//     WorkspaceHeader
+//     WorkspaceNode[nodeCount]   one for each Operator, Shape, Modifier and module call
+//     uint32_t[childCount]       indexes of nodes.  Children of a node are a range of it
+//     blobs                      PNG files of module images
+// Nodes refer to each other and to blobs only by index and offset, so the file is used
+// in place after mmap() without parsing.
+struct WorkspaceHeader {
+    char magic[8];      // "ASMCADW"
+    uint32_t version;
+    uint32_t byteOrder; // 0x01020304 as written by this machine
+    uint32_t nodeSize;  // sizeof(WorkspaceNode)
+    uint32_t nodeCount;
+    uint32_t childCount;
+    uint32_t mainFirst, mainCount;     // children of Main
+    uint32_t labelsFirst, labelsCount; // children of Labels
+    uint32_t unused;
+    uint64_t nodesOffset, childrenOffset, fileSize;
+};
+
+struct WorkspaceNode {
+    enum Kind {OPERATOR, MODULE, SHAPE, MODIFIER};
+    uint8_t kind;
+    uint8_t type;     // Operator::OperatorType, Shape::ShapeType or Modifier::ModifierType
+    uint16_t unused;
+    int32_t moduleId; // OPERATOR: id of its module or 0.  MODULE: id of the called module
+    uint32_t firstChild, childCount; // OPERATOR
+    double values[3], deltas[3];     // SHAPE and MODIFIER: x,y,z Inputs
+    uint64_t imgOffset, imgSize;     // OPERATOR: PNG image of its module.  imgSize is 0 if there is none
+};
+
+// this class has to be initialized by calling Workspace::setLayouts()
+class Workspace {
+    static std::shared_ptr<Main> main;
+    static std::shared_ptr<Labels> labels;
+public:
+    static const uint32_t VERSION = 1;
+    static void setLayouts(std::shared_ptr<Main> const & maiN, std::shared_ptr<Labels> const & labelS){ main = maiN; labels = labelS; }
+    static bool save(const std::string& fileName); // returns false on error
+    static bool load(const std::string& fileName); // adds saved objects to main and labels.  Returns false on error
+};